@@ -14,6 +14,16 @@
 #if defined(OS_LINUX) || defined(OS_MAC)
 #include <unistd.h>
 
+// Define RANG_CAPABILITY_CACHE before including rang.hpp to enable the
+// optional on-disk cache of detected terminal capabilities.
+#ifdef RANG_CAPABILITY_CACHE
+#define RANG_USE_CAPABILITY_CACHE
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <cstdio>
+#endif
+
 #elif defined(OS_WIN)
 
 #if defined(_WIN32_WINNT) && (_WIN32_WINNT < 0x0600)
@@ -38,9 +48,11 @@
 
 #include <algorithm>
 #include <atomic>
+#include <cstdint>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <string>
 
 namespace rang {
 
@@ -122,38 +134,312 @@ enum class winTerm {  // Windows Terminal Mode
 // Use rang::setWinTermMode to explicitly set terminal API for Windows
 // Calling rang::setWinTermMode have no effect on other OS
 
+// Define RANG_INSTRUMENTATION before including rang.hpp to count what rang
+// emits. Without it every counting hook compiles to nothing.
+struct instrumentation {
+    // Escape sequences emitted per attribute family
+    std::uint64_t style;
+    std::uint64_t fg;
+    std::uint64_t bg;
+    std::uint64_t fgB;
+    std::uint64_t bgB;
+    // Bytes of escape sequences and, where rang writes it, of plain text
+    std::uint64_t escapeBytes;
+    std::uint64_t textBytes;
+    // Colorize decisions by reason
+    std::uint64_t off;  // control::Off
+    std::uint64_t force;  // control::Force
+    std::uint64_t noTerm;  // TERM missing or not a color terminal
+    std::uint64_t notTty;  // stream is not a terminal
+    std::uint64_t terminal;  // control::Auto on a color terminal
+};
+
 namespace rang_implementation {
 
+    /* The modes are read on every styled insertion from any thread and
+     * written almost never, so each gets a cache line of its own: writes to
+     * neighbouring data must not evict them from the readers' caches.
+     */
+    template <typename T>
+    struct alignas(64) modeSlot {
+        std::atomic<T> value;
+    };
+
     inline std::atomic<control> &controlMode() noexcept
     {
-        static std::atomic<control> value(control::Auto);
-        return value;
+        static modeSlot<control> slot = { { control::Auto } };
+        return slot.value;
     }
 
     inline std::atomic<winTerm> &winTermMode() noexcept
     {
-        static std::atomic<winTerm> termMode(winTerm::Auto);
-        return termMode;
+        static modeSlot<winTerm> slot = { { winTerm::Auto } };
+        return slot.value;
+    }
+
+    // Stores only on change, re-applying a setting leaves the line shared
+    template <typename T>
+    inline void storeMode(std::atomic<T> &mode, T const value) noexcept
+    {
+        if (mode.load(std::memory_order_relaxed) != value) {
+            mode.store(value, std::memory_order_relaxed);
+        }
+    }
+
+    enum counter : std::size_t {
+        styleCounter,
+        fgCounter,
+        bgCounter,
+        fgBCounter,
+        bgBCounter,
+        escapeBytesCounter,
+        textBytesCounter,
+        offCounter,
+        forceCounter,
+        noTermCounter,
+        notTtyCounter,
+        terminalCounter,
+        counterCount
+    };
+
+#ifdef RANG_INSTRUMENTATION
+
+    constexpr std::size_t counterShards = 16;
+
+    // One cache line per shard so threads never contend on a counter
+    struct alignas(64) counterShard {
+        std::atomic<std::uint64_t> value[counterCount];
+    };
+
+    inline counterShard *shards() noexcept
+    {
+        static counterShard all[counterShards];
+        return all;
+    }
+
+    inline counterShard &localShard() noexcept
+    {
+        static std::atomic<unsigned> nextShard(0);
+        static thread_local counterShard &shard
+          = shards()[nextShard.fetch_add(1, std::memory_order_relaxed)
+                     % counterShards];
+        return shard;
+    }
+
+    inline void count(counter id, std::uint64_t n = 1) noexcept
+    {
+        localShard().value[id].fetch_add(n, std::memory_order_relaxed);
+    }
+
+#else
+
+    inline void count(counter, std::uint64_t = 1) noexcept {}
+
+#endif
+
+    inline counter familyCounter(rang::style) noexcept { return styleCounter; }
+    inline counter familyCounter(rang::fg) noexcept { return fgCounter; }
+    inline counter familyCounter(rang::bg) noexcept { return bgCounter; }
+    inline counter familyCounter(rang::fgB) noexcept { return fgBCounter; }
+    inline counter familyCounter(rang::bgB) noexcept { return bgBCounter; }
+
+    template <typename T>
+    inline void countSequence(T const value, std::size_t bytes) noexcept
+    {
+        count(familyCounter(value));
+        count(escapeBytesCounter, bytes);
+    }
+
+#if defined(OS_LINUX) || defined(OS_MAC)
+
+    inline bool detectColorSupport() noexcept
+    {
+        const char *Terms[]
+          = { "ansi",    "color",  "console", "cygwin", "gnome",
+              "konsole", "kterm",  "linux",   "msys",   "putty",
+              "rxvt",    "screen", "vt100",   "xterm" };
+
+        const char *env_p = std::getenv("TERM");
+        if (env_p == nullptr) {
+            return false;
+        }
+        return std::any_of(std::begin(Terms), std::end(Terms),
+                           [&](const char *term) {
+                               return std::strstr(env_p, term) != nullptr;
+                           });
+    }
+
+#endif
+
+#ifdef RANG_USE_CAPABILITY_CACHE
+
+    /* Capabilities are cached in a single fixed-size record. The record is
+     * keyed by TERM, COLORTERM and the devices behind stdout/stderr, so a
+     * stale entry is simply recomputed and replaced.
+     */
+    struct capabilityRecord {
+        std::uint32_t magic;
+        std::uint32_t version;
+        std::uint64_t key;  // hash of TERM, COLORTERM and tty devices
+        std::uint32_t flags;  // colorFlag, coutTermFlag, cerrTermFlag
+        std::uint32_t check;  // rejects torn or foreign files
+    };
+
+    constexpr std::uint32_t colorFlag    = 1;
+    constexpr std::uint32_t coutTermFlag = 2;
+    constexpr std::uint32_t cerrTermFlag = 4;
+    constexpr std::uint32_t capabilityMagic   = 0x676e6172;  // "rang"
+    constexpr std::uint32_t capabilityVersion = 1;
+
+    inline char *capabilityCachePath() noexcept
+    {
+        static char path[4096] = { 0 };
+        return path;
+    }
+
+    inline std::uint64_t fnv1a(std::uint64_t hash, const void *data,
+                               std::size_t size) noexcept
+    {
+        const unsigned char *p = static_cast<const unsigned char *>(data);
+        for (std::size_t i = 0; i < size; ++i) {
+            hash = (hash ^ p[i]) * 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    inline std::uint64_t hashEnv(std::uint64_t hash, const char *name) noexcept
+    {
+        const char *value = std::getenv(name);
+        // A separator keeps unset and empty variables apart
+        const char mark = value == nullptr ? '\1' : '\0';
+        if (value != nullptr) {
+            hash = fnv1a(hash, value, std::strlen(value));
+        }
+        return fnv1a(hash, &mark, 1);
+    }
+
+    inline std::uint64_t hashDevice(std::uint64_t hash, int fd) noexcept
+    {
+        struct stat st;
+        std::uint64_t dev = 0;
+        if (fstat(fd, &st) == 0 && S_ISCHR(st.st_mode)) {
+            dev = static_cast<std::uint64_t>(st.st_rdev) + 1;
+        }
+        return fnv1a(hash, &dev, sizeof(dev));
+    }
+
+    inline std::uint64_t capabilityKey() noexcept
+    {
+        std::uint64_t key = 0xcbf29ce484222325ULL;
+        key               = hashEnv(key, "TERM");
+        key               = hashEnv(key, "COLORTERM");
+        key               = hashDevice(key, fileno(stdout));
+        return hashDevice(key, fileno(stderr));
     }
 
+    inline std::uint32_t capabilityCheck(std::uint64_t key,
+                                         std::uint32_t flags) noexcept
+    {
+        const std::uint64_t hash = fnv1a(key, &flags, sizeof(flags));
+        return static_cast<std::uint32_t>(hash ^ (hash >> 32));
+    }
+
+    inline bool loadCapabilities(const char *path, std::uint64_t key,
+                                 std::uint32_t &flags) noexcept
+    {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return false;
+        }
+        struct stat st;
+        void *map = MAP_FAILED;
+        if (fstat(fd, &st) == 0
+            && st.st_size == static_cast<off_t>(sizeof(capabilityRecord))) {
+            map = mmap(nullptr, sizeof(capabilityRecord), PROT_READ,
+                       MAP_PRIVATE, fd, 0);
+        }
+        close(fd);
+        if (map == MAP_FAILED) {
+            return false;
+        }
+        capabilityRecord record;
+        std::memcpy(&record, map, sizeof(record));
+        munmap(map, sizeof(capabilityRecord));
+
+        if (record.magic != capabilityMagic
+            || record.version != capabilityVersion || record.key != key
+            || record.check != capabilityCheck(key, record.flags)) {
+            return false;
+        }
+        flags = record.flags;
+        return true;
+    }
+
+    inline bool storeCapabilities(const char *path, std::uint64_t key,
+                                  std::uint32_t flags) noexcept
+    {
+        // Write a private temporary file and rename it over the cache so
+        // concurrent readers only ever observe a complete record
+        char tmp[4096 + 32];
+        const int n = std::snprintf(tmp, sizeof(tmp), "%s.%ld.tmp", path,
+                                    static_cast<long>(getpid()));
+        if (n < 0 || static_cast<std::size_t>(n) >= sizeof(tmp)) {
+            return false;
+        }
+        const int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                            0644);
+        if (fd < 0) {
+            return false;
+        }
+        const capabilityRecord record = { capabilityMagic, capabilityVersion,
+                                          key, flags,
+                                          capabilityCheck(key, flags) };
+        const bool written
+          = write(fd, &record, sizeof(record))
+          == static_cast<ssize_t>(sizeof(record));
+        if (close(fd) != 0 || !written || std::rename(tmp, path) != 0) {
+            unlink(tmp);
+            return false;
+        }
+        return true;
+    }
+
+    inline bool capabilityCacheEnabled() noexcept
+    {
+        return capabilityCachePath()[0] != '\0';
+    }
+
+    inline std::uint32_t cachedCapabilities() noexcept
+    {
+        static const std::uint32_t flags = [] {
+            const char *path        = capabilityCachePath();
+            const std::uint64_t key = capabilityKey();
+            std::uint32_t value     = 0;
+            if (loadCapabilities(path, key, value)) {
+                return value;
+            }
+            value = (detectColorSupport() ? colorFlag : 0)
+              | (isatty(fileno(stdout)) ? coutTermFlag : 0)
+              | (isatty(fileno(stderr)) ? cerrTermFlag : 0);
+            storeCapabilities(path, key, value);
+            return value;
+        }();
+        return flags;
+    }
+
+#endif
+
     inline bool supportsColor() noexcept
     {
 #if defined(OS_LINUX) || defined(OS_MAC)
 
         static const bool result = [] {
-            const char *Terms[]
-              = { "ansi",    "color",  "console", "cygwin", "gnome",
-                  "konsole", "kterm",  "linux",   "msys",   "putty",
-                  "rxvt",    "screen", "vt100",   "xterm" };
-
-            const char *env_p = std::getenv("TERM");
-            if (env_p == nullptr) {
-                return false;
+#ifdef RANG_USE_CAPABILITY_CACHE
+            if (capabilityCacheEnabled()) {
+                return (cachedCapabilities() & colorFlag) != 0;
             }
-            return std::any_of(std::begin(Terms), std::end(Terms),
-                               [&](const char *term) {
-                                   return std::strstr(env_p, term) != nullptr;
-                               });
+#endif
+            return detectColorSupport();
         }();
 
 #elif defined(OS_WIN)
@@ -218,25 +504,65 @@ namespace rang_implementation {
 
 #endif
 
-    inline bool isTerminal(const std::streambuf *osbuf) noexcept
+    // Which standard stream osbuf belongs to: 1 stdout, 2 stderr, 0 none
+    inline int standardStream(const std::streambuf *osbuf) noexcept
     {
-        using std::cerr;
-        using std::clog;
-        using std::cout;
+        if (osbuf == std::cout.rdbuf()) {
+            return 1;
+        } else if (osbuf == std::cerr.rdbuf() || osbuf == std::clog.rdbuf()) {
+            return 2;
+        }
+        return 0;
+    }
+
+    inline int standardStream(const std::wstreambuf *osbuf) noexcept
+    {
+        if (osbuf == std::wcout.rdbuf()) {
+            return 1;
+        } else if (osbuf == std::wcerr.rdbuf()
+                   || osbuf == std::wclog.rdbuf()) {
+            return 2;
+        }
+        return 0;
+    }
+
+    // Other character types have no standard streams
+    template <typename CharT, typename Traits>
+    inline int
+    standardStream(const std::basic_streambuf<CharT, Traits> *) noexcept
+    {
+        return 0;
+    }
+
+    template <typename CharT, typename Traits>
+    inline bool
+    isTerminal(const std::basic_streambuf<CharT, Traits> *osbuf) noexcept
+    {
+        const int stream = standardStream(osbuf);
 #if defined(OS_LINUX) || defined(OS_MAC)
-        if (osbuf == cout.rdbuf()) {
+#ifdef RANG_USE_CAPABILITY_CACHE
+        if (capabilityCacheEnabled()) {
+            if (stream == 1) {
+                return (cachedCapabilities() & coutTermFlag) != 0;
+            } else if (stream == 2) {
+                return (cachedCapabilities() & cerrTermFlag) != 0;
+            }
+            return false;
+        }
+#endif
+        if (stream == 1) {
             static const bool cout_term = isatty(fileno(stdout)) != 0;
             return cout_term;
-        } else if (osbuf == cerr.rdbuf() || osbuf == clog.rdbuf()) {
+        } else if (stream == 2) {
             static const bool cerr_term = isatty(fileno(stderr)) != 0;
             return cerr_term;
         }
 #elif defined(OS_WIN)
-        if (osbuf == cout.rdbuf()) {
+        if (stream == 1) {
             static const bool cout_term
               = (_isatty(_fileno(stdout)) || isMsysPty(_fileno(stdout)));
             return cout_term;
-        } else if (osbuf == cerr.rdbuf() || osbuf == clog.rdbuf()) {
+        } else if (stream == 2) {
             static const bool cerr_term
               = (_isatty(_fileno(stderr)) || isMsysPty(_fileno(stderr)));
             return cerr_term;
@@ -246,11 +572,92 @@ namespace rang_implementation {
     }
 
     template <typename T>
-    using enableStd = typename std::enable_if<
+    using isAttribute = std::integral_constant<
+      bool,
       std::is_same<T, rang::style>::value || std::is_same<T, rang::fg>::value
         || std::is_same<T, rang::bg>::value || std::is_same<T, rang::fgB>::value
-        || std::is_same<T, rang::bgB>::value,
-      std::ostream &>::type;
+        || std::is_same<T, rang::bgB>::value>;
+
+    template <typename T, typename CharT = char,
+              typename Traits = std::char_traits<CharT>>
+    using enableStd =
+      typename std::enable_if<isAttribute<T>::value,
+                              std::basic_ostream<CharT, Traits> &>::type;
+
+    template <std::size_t... I>
+    struct indexList {
+    };
+
+    template <std::size_t N, std::size_t... I>
+    struct makeIndexList : makeIndexList<N - 1, N - 1, I...> {
+    };
+
+    template <std::size_t... I>
+    struct makeIndexList<0, I...> {
+        typedef indexList<I...> type;
+    };
+
+    // "\033[<code>m" in the character type of a stream
+    template <typename CharT>
+    struct sgrText {
+        CharT text[7];
+        std::size_t size;
+    };
+
+    constexpr std::size_t sgrDigits(std::size_t code) noexcept
+    {
+        return code >= 100 ? 3 : code >= 10 ? 2 : 1;
+    }
+
+    constexpr std::size_t pow10(std::size_t exponent) noexcept
+    {
+        return exponent == 0 ? 1 : 10 * pow10(exponent - 1);
+    }
+
+    // Char i of the sequence of code, 0 past its end
+    template <typename CharT>
+    constexpr CharT sgrChar(std::size_t code, std::size_t i) noexcept
+    {
+        return i == 0 ? CharT('\033')
+          : i == 1    ? CharT('[')
+          : i - 2 < sgrDigits(code)
+          ? CharT('0' + code / pow10(sgrDigits(code) - 1 - (i - 2)) % 10)
+          : i - 2 == sgrDigits(code) ? CharT('m')
+                                     : CharT();
+    }
+
+    template <typename CharT>
+    constexpr sgrText<CharT> makeSgrText(std::size_t code) noexcept
+    {
+        return { { sgrChar<CharT>(code, 0), sgrChar<CharT>(code, 1),
+                   sgrChar<CharT>(code, 2), sgrChar<CharT>(code, 3),
+                   sgrChar<CharT>(code, 4), sgrChar<CharT>(code, 5),
+                   sgrChar<CharT>(code, 6) },
+                 3 + sgrDigits(code) };
+    }
+
+    // Sequence of every SGR code up to bgB::gray, built at compile time
+    template <typename CharT, typename = typename makeIndexList<108>::type>
+    struct sgrTable;
+
+    template <typename CharT, std::size_t... I>
+    struct sgrTable<CharT, indexList<I...>> {
+        static constexpr sgrText<CharT> entry[sizeof...(I)]
+          = { makeSgrText<CharT>(I)... };
+    };
+
+    template <typename CharT, std::size_t... I>
+    constexpr sgrText<CharT> sgrTable<CharT, indexList<I...>>::entry[];
+
+    template <typename T, typename CharT, typename Traits>
+    inline void writeSequence(std::basic_ostream<CharT, Traits> &os,
+                              T const value)
+    {
+        const sgrText<CharT> &seq
+          = sgrTable<CharT>::entry[static_cast<std::size_t>(value)];
+        countSequence(value, seq.size * sizeof(CharT));
+        os.write(seq.text, static_cast<std::streamsize>(seq.size));
+    }
 
 
 #ifdef OS_WIN
@@ -275,21 +682,21 @@ namespace rang_implementation {
         gray    = 7
     };
 
-    inline HANDLE getConsoleHandle(const std::streambuf *osbuf) noexcept
+    inline HANDLE getConsoleHandle(int stream) noexcept
     {
-        if (osbuf == std::cout.rdbuf()) {
+        if (stream == 1) {
             static const HANDLE hStdout = GetStdHandle(STD_OUTPUT_HANDLE);
             return hStdout;
-        } else if (osbuf == std::cerr.rdbuf() || osbuf == std::clog.rdbuf()) {
+        } else if (stream == 2) {
             static const HANDLE hStderr = GetStdHandle(STD_ERROR_HANDLE);
             return hStderr;
         }
         return INVALID_HANDLE_VALUE;
     }
 
-    inline bool setWinTermAnsiColors(const std::streambuf *osbuf) noexcept
+    inline bool setWinTermAnsiColors(int stream) noexcept
     {
-        HANDLE h = getConsoleHandle(osbuf);
+        HANDLE h = getConsoleHandle(stream);
         if (h == INVALID_HANDLE_VALUE) {
             return false;
         }
@@ -304,18 +711,18 @@ namespace rang_implementation {
         return true;
     }
 
-    inline bool supportsAnsi(const std::streambuf *osbuf) noexcept
+    template <typename CharT, typename Traits>
+    inline bool
+    supportsAnsi(const std::basic_streambuf<CharT, Traits> *osbuf) noexcept
     {
-        using std::cerr;
-        using std::clog;
-        using std::cout;
-        if (osbuf == cout.rdbuf()) {
+        const int stream = standardStream(osbuf);
+        if (stream == 1) {
             static const bool cout_ansi
-              = (isMsysPty(_fileno(stdout)) || setWinTermAnsiColors(osbuf));
+              = (isMsysPty(_fileno(stdout)) || setWinTermAnsiColors(stream));
             return cout_ansi;
-        } else if (osbuf == cerr.rdbuf() || osbuf == clog.rdbuf()) {
+        } else if (stream == 2) {
             static const bool cerr_ansi
-              = (isMsysPty(_fileno(stderr)) || setWinTermAnsiColors(osbuf));
+              = (isMsysPty(_fileno(stderr)) || setWinTermAnsiColors(stream));
             return cerr_ansi;
         }
         return false;
@@ -423,17 +830,20 @@ namespace rang_implementation {
         return attrib;
     }
 
-    template <typename T>
-    inline void setWinColorAnsi(std::ostream &os, T const value)
+    template <typename T, typename CharT, typename Traits>
+    inline void setWinColorAnsi(std::basic_ostream<CharT, Traits> &os,
+                                T const value)
     {
-        os << "\033[" << static_cast<int>(value) << "m";
+        writeSequence(os, value);
     }
 
-    template <typename T>
-    inline void setWinColorNative(std::ostream &os, T const value)
+    template <typename T, typename CharT, typename Traits>
+    inline void setWinColorNative(std::basic_ostream<CharT, Traits> &os,
+                                  T const value)
     {
-        const HANDLE h = getConsoleHandle(os.rdbuf());
+        const HANDLE h = getConsoleHandle(standardStream(os.rdbuf()));
         if (h != INVALID_HANDLE_VALUE) {
+            countSequence(value, 0);
             setWinSGR(value, current_state());
             // Out all buffered text to console with previous settings:
             os.flush();
@@ -441,16 +851,18 @@ namespace rang_implementation {
         }
     }
 
-    template <typename T>
-    inline enableStd<T> setColor(std::ostream &os, T const value)
+    template <typename T, typename CharT, typename Traits>
+    inline enableStd<T, CharT, Traits>
+    setColor(std::basic_ostream<CharT, Traits> &os, T const value)
     {
-        if (winTermMode() == winTerm::Auto) {
+        const winTerm mode = winTermMode().load(std::memory_order_relaxed);
+        if (mode == winTerm::Auto) {
             if (supportsAnsi(os.rdbuf())) {
                 setWinColorAnsi(os, value);
             } else {
                 setWinColorNative(os, value);
             }
-        } else if (winTermMode() == winTerm::Ansi) {
+        } else if (mode == winTerm::Ansi) {
             setWinColorAnsi(os, value);
         } else {
             setWinColorNative(os, value);
@@ -458,44 +870,364 @@ namespace rang_implementation {
         return os;
     }
 #else
+    template <typename T, typename CharT, typename Traits>
+    inline enableStd<T, CharT, Traits>
+    setColor(std::basic_ostream<CharT, Traits> &os, T const value)
+    {
+        writeSequence(os, value);
+        return os;
+    }
+#endif
+
     template <typename T>
-    inline enableStd<T> setColor(std::ostream &os, T const value)
+    inline std::string openSequence(T const value)
     {
-        return os << "\033[" << static_cast<int>(value) << "m";
+        return "\033[" + std::to_string(static_cast<int>(value)) + "m";
+    }
+
+    // Undo a single attribute without disturbing the other ones in effect
+    inline std::string closeSequence(rang::style const value)
+    {
+        switch (value) {
+            case rang::style::bold:
+            case rang::style::dim: return "\033[22m";
+            case rang::style::italic: return "\033[23m";
+            case rang::style::underline: return "\033[24m";
+            case rang::style::blink:
+            case rang::style::rblink: return "\033[25m";
+            case rang::style::reversed: return "\033[27m";
+            case rang::style::conceal: return "\033[28m";
+            case rang::style::crossed: return "\033[29m";
+            default: return "\033[0m";
+        }
     }
+
+    inline std::string closeSequence(rang::fg) { return "\033[39m"; }
+    inline std::string closeSequence(rang::fgB) { return "\033[39m"; }
+    inline std::string closeSequence(rang::bg) { return "\033[49m"; }
+    inline std::string closeSequence(rang::bgB) { return "\033[49m"; }
+
+    // Whether styling should be applied to osbuf under the control mode
+    template <typename CharT, typename Traits>
+    inline bool
+    colorize(const std::basic_streambuf<CharT, Traits> *osbuf) noexcept
+    {
+        switch (controlMode().load(std::memory_order_relaxed)) {
+            case control::Auto:
+                if (!supportsColor()) {
+                    count(noTermCounter);
+                    return false;
+                }
+                if (!isTerminal(osbuf)) {
+                    count(notTtyCounter);
+                    return false;
+                }
+                count(terminalCounter);
+                return true;
+            case control::Force: count(forceCounter); return true;
+            default: count(offCounter); return false;
+        }
+    }
+
+    // Whether styling osbuf means ANSI sequences rather than console calls
+    template <typename CharT, typename Traits>
+    inline bool
+    ansiOutput(const std::basic_streambuf<CharT, Traits> *osbuf) noexcept
+    {
+#ifdef OS_WIN
+        const winTerm mode = winTermMode().load(std::memory_order_relaxed);
+        return mode == winTerm::Ansi
+          || (mode == winTerm::Auto && supportsAnsi(osbuf));
+#else
+        (void)osbuf;
+        return true;
 #endif
+    }
+
+    // Whether raw ANSI sequences may be written straight into osbuf. Used by
+    // components which render escapes into their own buffers.
+    template <typename CharT, typename Traits>
+    inline bool
+    ansiEnabled(const std::basic_streambuf<CharT, Traits> *osbuf) noexcept
+    {
+        return colorize(osbuf) && ansiOutput(osbuf);
+    }
+}  // namespace rang_implementation
+
+template <typename CharT, typename Traits, typename T>
+inline rang_implementation::enableStd<T, CharT, Traits>
+operator<<(std::basic_ostream<CharT, Traits> &os, const T value)
+{
+    return rang_implementation::colorize(os.rdbuf())
+      ? rang_implementation::setColor(os, value)
+      : os;
+}
+
+/* Every rang attribute in effect at once, packed into 32 bits:
+ * foreground and background as 0 (default), 1-8 (normal) or 9-16 (bright)
+ * and one bit per style. Used by components that store styled content and
+ * emit only the difference between consecutive attributes.
+ */
+class attribute {
+public:
+    constexpr attribute() noexcept : bits(0) {}
+
+    template <typename T, typename = typename std::enable_if<
+                            rang_implementation::isAttribute<T>::value>::type>
+    attribute(T const value) noexcept : bits(0)
+    {
+        apply(value);
+    }
+
+    attribute &apply(rang::style const value) noexcept
+    {
+        if (value == rang::style::reset) {
+            bits = 0;
+        } else {
+            bits |= 1u << (styleShift + static_cast<unsigned>(value) - 1);
+        }
+        return *this;
+    }
+
+    attribute &apply(rang::fg const value) noexcept
+    {
+        return setColor(fgShift, value == rang::fg::reset
+                                   ? 0
+                                   : static_cast<unsigned>(value) - 29);
+    }
+
+    attribute &apply(rang::fgB const value) noexcept
+    {
+        return setColor(fgShift, static_cast<unsigned>(value) - 81);
+    }
+
+    attribute &apply(rang::bg const value) noexcept
+    {
+        return setColor(bgShift, value == rang::bg::reset
+                                   ? 0
+                                   : static_cast<unsigned>(value) - 39);
+    }
+
+    attribute &apply(rang::bgB const value) noexcept
+    {
+        return setColor(bgShift, static_cast<unsigned>(value) - 91);
+    }
+
+    // Layer value on top: its styles are added, its colors win if set
+    attribute &apply(attribute const value) noexcept
+    {
+        const unsigned fgKeep = value.fgColor() ? value.fgColor() : fgColor();
+        const unsigned bgKeep = value.bgColor() ? value.bgColor() : bgColor();
+        bits |= value.bits;
+        setColor(fgShift, fgKeep);
+        return setColor(bgShift, bgKeep);
+    }
+
+    bool has(rang::style const value) const noexcept
+    {
+        return value != rang::style::reset
+          && (bits >> (styleShift + static_cast<unsigned>(value) - 1)) & 1u;
+    }
+
+    // SGR parameter of the foreground/background, the reset code if unset
+    int fgCode() const noexcept { return colorCode(fgColor(), 30, 90); }
+    int bgCode() const noexcept { return colorCode(bgColor(), 40, 100); }
+
+    std::uint32_t raw() const noexcept { return bits; }
+    static attribute fromRaw(std::uint32_t raw) noexcept
+    {
+        attribute value;
+        value.bits = raw;
+        return value;
+    }
+
+    bool operator==(attribute const other) const noexcept
+    {
+        return bits == other.bits;
+    }
+    bool operator!=(attribute const other) const noexcept
+    {
+        return bits != other.bits;
+    }
+
+    unsigned fgColor() const noexcept { return (bits >> fgShift) & colorMask; }
+    unsigned bgColor() const noexcept { return (bits >> bgShift) & colorMask; }
+    unsigned styles() const noexcept { return bits >> styleShift; }
+
+private:
+    static constexpr unsigned fgShift    = 0;
+    static constexpr unsigned bgShift    = 8;
+    static constexpr unsigned styleShift = 16;
+    static constexpr std::uint32_t colorMask = 0x1f;
+
+    attribute &setColor(unsigned shift, unsigned color) noexcept
+    {
+        bits = (bits & ~(colorMask << shift)) | (color << shift);
+        return *this;
+    }
+
+    static int colorCode(unsigned color, int normal, int bright) noexcept
+    {
+        return color == 0 ? normal + 9
+                          : color <= 8 ? normal + static_cast<int>(color) - 1
+                                       : bright + static_cast<int>(color) - 9;
+    }
+
+    std::uint32_t bits;
+};
+
+namespace rang_implementation {
+
+    // Longest output of writeTransition()
+    constexpr std::size_t maxTransition = 64;
+
+    inline char *writeCode(char *out, int code) noexcept
+    {
+        if (code >= 100) {
+            *out++ = static_cast<char>('0' + code / 100);
+        }
+        if (code >= 10) {
+            *out++ = static_cast<char>('0' + code / 10 % 10);
+        }
+        *out++ = static_cast<char>('0' + code % 10);
+        *out++ = ';';
+        return out;
+    }
+
+    /* Write the shortest single SGR sequence taking a terminal from one
+     * attribute to another into out, which must hold maxTransition chars.
+     * Returns the number of chars written, 0 if nothing changes.
+     */
+    inline std::size_t writeTransition(attribute from, attribute const to,
+                                       char *out) noexcept
+    {
+        if (from == to) {
+            return 0;
+        }
+        char *p = out;
+        *p++    = '\033';
+        *p++    = '[';
+        if (to == attribute()
+            || (from.styles() & ~to.styles()) != 0) {
+            // Styles can only be dropped reliably by a full reset
+            p    = writeCode(p, 0);
+            from = attribute();
+        }
+        const unsigned added = to.styles() & ~from.styles();
+        for (int i = 0; i < 9; ++i) {
+            if ((added >> i) & 1u) {
+                p = writeCode(p, i + 1);
+            }
+        }
+        if (to.fgColor() != from.fgColor()) {
+            p = writeCode(p, to.fgCode());
+        }
+        if (to.bgColor() != from.bgColor()) {
+            p = writeCode(p, to.bgCode());
+        }
+        p[-1] = 'm';
+        return static_cast<std::size_t>(p - out);
+    }
+
+}  // namespace rang_implementation
+
+namespace rang_implementation {
+
+    // Bring os to value once colorize() agreed, through the console on
+    // Windows when it does not take ANSI sequences
+    inline void setAttribute(std::ostream &os, attribute const value)
+    {
+        setColor(os, style::reset);
+        for (int i = 0; i < 9; ++i) {
+            if ((value.styles() >> i) & 1u) {
+                setColor(os, static_cast<style>(i + 1));
+            }
+        }
+        if (value.fgColor() > 8) {
+            setColor(os, static_cast<fgB>(value.fgCode()));
+        } else if (value.fgColor() != 0) {
+            setColor(os, static_cast<fg>(value.fgCode()));
+        }
+        if (value.bgColor() > 8) {
+            setColor(os, static_cast<bgB>(value.bgCode()));
+        } else if (value.bgColor() != 0) {
+            setColor(os, static_cast<bg>(value.bgCode()));
+        }
+    }
+
 }  // namespace rang_implementation
 
-template <typename T>
-inline rang_implementation::enableStd<T> operator<<(std::ostream &os,
-                                                    const T value)
+/* Bring os to value, deciding once under the control mode, so the usual
+ * control and Windows console handling applies.
+ */
+inline std::ostream &operator<<(std::ostream &os, attribute const value)
 {
-    const control option = rang_implementation::controlMode();
-    switch (option) {
-        case control::Auto:
-            return rang_implementation::supportsColor()
-                && rang_implementation::isTerminal(os.rdbuf())
-              ? rang_implementation::setColor(os, value)
-              : os;
-        case control::Force: return rang_implementation::setColor(os, value);
-        default: return os;
+    if (rang_implementation::colorize(os.rdbuf())) {
+        rang_implementation::setAttribute(os, value);
     }
+    return os;
 }
 
 inline void setWinTermMode(const rang::winTerm value) noexcept
 {
-    rang_implementation::winTermMode() = value;
+    rang_implementation::storeMode(rang_implementation::winTermMode(), value);
 }
 
 inline void setControlMode(const control value) noexcept
 {
-    rang_implementation::controlMode() = value;
+    rang_implementation::storeMode(rang_implementation::controlMode(), value);
 }
 
+#ifdef RANG_INSTRUMENTATION
+// Sum of all counters since start or the last resetInstrumentation()
+inline instrumentation instrumentationSnapshot() noexcept
+{
+    std::uint64_t total[rang_implementation::counterCount] = {};
+    const rang_implementation::counterShard *shards
+      = rang_implementation::shards();
+    for (std::size_t s = 0; s < rang_implementation::counterShards; ++s) {
+        for (std::size_t i = 0; i < rang_implementation::counterCount; ++i) {
+            total[i] += shards[s].value[i].load(std::memory_order_relaxed);
+        }
+    }
+    using namespace rang_implementation;
+    const instrumentation snapshot
+      = { total[styleCounter],       total[fgCounter],
+          total[bgCounter],          total[fgBCounter],
+          total[bgBCounter],         total[escapeBytesCounter],
+          total[textBytesCounter],   total[offCounter],
+          total[forceCounter],       total[noTermCounter],
+          total[notTtyCounter],      total[terminalCounter] };
+    return snapshot;
+}
+
+inline void resetInstrumentation() noexcept
+{
+    rang_implementation::counterShard *shards = rang_implementation::shards();
+    for (std::size_t s = 0; s < rang_implementation::counterShards; ++s) {
+        for (auto &value : shards[s].value) {
+            value.store(0, std::memory_order_relaxed);
+        }
+    }
+}
+#endif
+
+#ifdef RANG_USE_CAPABILITY_CACHE
+// Cache detected capabilities in the file at path across process launches.
+// Must be called before the first styled output since detection is memoized.
+inline void setCapabilityCache(const char *path) noexcept
+{
+    char *dest = rang_implementation::capabilityCachePath();
+    std::strncpy(dest, path, 4095);
+    dest[4095] = '\0';
+}
+#endif
+
 }  // namespace rang
 
 #undef OS_LINUX
 #undef OS_WIN
+#undef RANG_USE_CAPABILITY_CACHE
 #undef OS_MAC
 
 #endif /* ifndef RANG_DOT_HPP */
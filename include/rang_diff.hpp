@@ -0,0 +1,776 @@
+#ifndef RANG_DIFF_DOT_HPP
+#define RANG_DIFF_DOT_HPP
+
+#include "rang.hpp"
+
+#include <climits>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace rang {
+
+// Attributes of the parts of a colored diff
+struct diffStyle {
+    attribute header  = style::bold;
+    attribute hunk    = fg::cyan;
+    attribute removed = fg::red;
+    attribute added   = fg::green;
+    // Changed words inside removed and added lines
+    attribute removedWord = attribute(fg::red).apply(style::reversed);
+    attribute addedWord   = attribute(fg::green).apply(style::reversed);
+};
+
+struct diffOptions {
+    std::string fromName = "a";
+    std::string toName   = "b";
+    int context          = 3;  // unchanged lines around each change
+    bool words           = true;  // highlight changed words in lines
+    diffStyle colors;
+};
+
+namespace rang_implementation {
+
+    // Hash of a byte range, consumed eight bytes at a time
+    inline std::uint64_t hashBytes(const char *p, std::size_t size) noexcept
+    {
+        const std::uint64_t k = 0x9e3779b97f4a7c15ULL;
+        std::uint64_t h       = size * k;
+        for (; size >= 8; p += 8, size -= 8) {
+            std::uint64_t word;
+            std::memcpy(&word, p, 8);
+            h = (h ^ word) * k;
+            h ^= h >> 29;
+        }
+        if (size != 0) {
+            std::uint64_t word = 0;
+            std::memcpy(&word, p, size);
+            h = (h ^ word) * k;
+            h ^= h >> 29;
+        }
+        return h ^ (h >> 32);
+    }
+
+    struct diffSpan {
+        const char *data;
+        std::size_t size;
+    };
+
+    /* Maps equal byte ranges to equal dense ids, so the diff compares
+     * integers only. Open addressing over a power of two table whose slots
+     * carry part of the hash, so probing rarely touches the entries.
+     */
+    class interner {
+    public:
+        // Size the table for count ranges up front
+        void reserve(std::size_t count)
+        {
+            spans.reserve(count);
+            if (count * 2 > slots.size()) {
+                rehash(count * 2);
+            }
+        }
+
+        std::uint32_t intern(const char *data, std::size_t size)
+        {
+            return intern(data, size, hashBytes(data, size));
+        }
+
+        // Fetch the table line for a range about to be interned
+        void prefetch(std::uint64_t const h) const noexcept
+        {
+#if defined(__GNUC__)
+            if (!slots.empty()) {
+                __builtin_prefetch(&slots[static_cast<std::size_t>(h) & mask]);
+            }
+#else
+            (void)h;
+#endif
+        }
+
+        std::uint32_t intern(const char *data, std::size_t size,
+                             std::uint64_t const h)
+        {
+            if ((spans.size() + 1) * 2 > slots.size()) {
+                rehash(slots.empty() ? 1024 : slots.size() * 2);
+            }
+            const std::uint32_t tag = static_cast<std::uint32_t>(h >> 32);
+            std::size_t i           = static_cast<std::size_t>(h) & mask;
+            for (;; i = (i + 1) & mask) {
+                const slot &s = slots[i];
+                if (s.id == 0) {
+                    break;
+                }
+                const diffSpan &e = spans[s.id - 1];
+                if (s.tag == tag && e.size == size
+                    && std::memcmp(e.data, data, size) == 0) {
+                    return s.id - 1;
+                }
+            }
+            spans.push_back({ data, size });
+            slots[i] = { tag, static_cast<std::uint32_t>(spans.size()) };
+            return static_cast<std::uint32_t>(spans.size() - 1);
+        }
+
+        std::size_t size() const noexcept { return spans.size(); }
+
+    private:
+        struct slot {
+            std::uint32_t tag;  // high half of the hash
+            std::uint32_t id;  // 0 when empty, id + 1 otherwise
+        };
+
+        void rehash(std::size_t minimum)
+        {
+            std::size_t size = 1024;
+            while (size < minimum) {
+                size *= 2;
+            }
+            std::vector<slot> table(size, slot{ 0, 0 });
+            mask = size - 1;
+            for (std::size_t s = 0; s < spans.size(); ++s) {
+                const std::uint64_t h = hashBytes(spans[s].data, spans[s].size);
+                std::size_t i         = static_cast<std::size_t>(h) & mask;
+                while (table[i].id != 0) {
+                    i = (i + 1) & mask;
+                }
+                table[i] = { static_cast<std::uint32_t>(h >> 32),
+                             static_cast<std::uint32_t>(s + 1) };
+            }
+            slots.swap(table);
+        }
+
+        std::vector<slot> slots;
+        std::vector<diffSpan> spans;
+        std::size_t mask = 0;
+    };
+
+    /* Myers' O(ND) difference algorithm in linear space: the middle snake
+     * of each range splits it in two until only insertions or deletions
+     * remain. Past a cost limit the furthest reaching path is taken as the
+     * split, which keeps the time bounded on very different inputs at the
+     * price of a diff that may not be minimal.
+     */
+    class myers {
+    public:
+        myers(const std::uint32_t *a, std::size_t n, const std::uint32_t *b,
+              std::size_t m, char *removed, char *added)
+            : a(a), b(b), removed(removed), added(added),
+              diagonals(n + m + 3), offset(static_cast<std::ptrdiff_t>(m) + 1)
+        {
+            fd.resize(diagonals);
+            bd.resize(diagonals);
+            tooExpensive = 1;
+            for (std::size_t d = diagonals; d != 0; d >>= 2) {
+                tooExpensive <<= 1;
+            }
+            tooExpensive = std::max<std::ptrdiff_t>(tooExpensive, 4096);
+            compare(0, static_cast<std::ptrdiff_t>(n), 0,
+                    static_cast<std::ptrdiff_t>(m));
+        }
+
+    private:
+        void compare(std::ptrdiff_t xoff, std::ptrdiff_t xlim,
+                     std::ptrdiff_t yoff, std::ptrdiff_t ylim)
+        {
+            while (xoff < xlim && yoff < ylim && a[xoff] == b[yoff]) {
+                ++xoff;
+                ++yoff;
+            }
+            while (xlim > xoff && ylim > yoff && a[xlim - 1] == b[ylim - 1]) {
+                --xlim;
+                --ylim;
+            }
+            if (xoff == xlim) {
+                std::fill(added + yoff, added + ylim, 1);
+            } else if (yoff == ylim) {
+                std::fill(removed + xoff, removed + xlim, 1);
+            } else {
+                std::ptrdiff_t xm, ym;
+                split(xoff, xlim, yoff, ylim, xm, ym);
+                compare(xoff, xm, yoff, ym);
+                compare(xm, xlim, ym, ylim);
+            }
+        }
+
+        std::ptrdiff_t &f(std::ptrdiff_t d) { return fd[d + offset]; }
+        std::ptrdiff_t &r(std::ptrdiff_t d) { return bd[d + offset]; }
+
+        void split(std::ptrdiff_t xoff, std::ptrdiff_t xlim,
+                   std::ptrdiff_t yoff, std::ptrdiff_t ylim,
+                   std::ptrdiff_t &xm, std::ptrdiff_t &ym)
+        {
+            const std::ptrdiff_t dmin = xoff - ylim, dmax = xlim - yoff;
+            const std::ptrdiff_t fmid = xoff - yoff, bmid = xlim - ylim;
+            std::ptrdiff_t fmin = fmid, fmax = fmid;
+            std::ptrdiff_t bmin = bmid, bmax = bmid;
+            const bool odd = ((fmid - bmid) & 1) != 0;
+            f(fmid)        = xoff;
+            r(bmid)        = xlim;
+
+            for (std::ptrdiff_t c = 1;; ++c) {
+                // One more edit forwards from the start
+                if (fmin > dmin) {
+                    f(--fmin - 1) = -1;
+                } else {
+                    ++fmin;
+                }
+                if (fmax < dmax) {
+                    f(++fmax + 1) = -1;
+                } else {
+                    --fmax;
+                }
+                for (std::ptrdiff_t d = fmax; d >= fmin; d -= 2) {
+                    const std::ptrdiff_t lo = f(d - 1), hi = f(d + 1);
+                    std::ptrdiff_t x = lo >= hi ? lo + 1 : hi;
+                    std::ptrdiff_t y = x - d;
+                    while (x < xlim && y < ylim && a[x] == b[y]) {
+                        ++x;
+                        ++y;
+                    }
+                    f(d) = x;
+                    if (odd && bmin <= d && d <= bmax && r(d) <= x) {
+                        xm = x;
+                        ym = y;
+                        return;
+                    }
+                }
+
+                // And backwards from the end
+                if (bmin > dmin) {
+                    r(--bmin - 1) = PTRDIFF_MAX;
+                } else {
+                    ++bmin;
+                }
+                if (bmax < dmax) {
+                    r(++bmax + 1) = PTRDIFF_MAX;
+                } else {
+                    --bmax;
+                }
+                for (std::ptrdiff_t d = bmax; d >= bmin; d -= 2) {
+                    const std::ptrdiff_t lo = r(d - 1), hi = r(d + 1);
+                    std::ptrdiff_t x = lo < hi ? lo : hi - 1;
+                    std::ptrdiff_t y = x - d;
+                    while (x > xoff && y > yoff && a[x - 1] == b[y - 1]) {
+                        --x;
+                        --y;
+                    }
+                    r(d) = x;
+                    if (!odd && fmin <= d && d <= fmax && x <= f(d)) {
+                        xm = x;
+                        ym = y;
+                        return;
+                    }
+                }
+
+                if (c >= tooExpensive) {
+                    furthest(xoff, xlim, yoff, ylim, fmin, fmax, bmin, bmax,
+                             xm, ym);
+                    return;
+                }
+            }
+        }
+
+        // Split at whichever path got furthest from its corner
+        void furthest(std::ptrdiff_t xoff, std::ptrdiff_t xlim,
+                      std::ptrdiff_t yoff, std::ptrdiff_t ylim,
+                      std::ptrdiff_t fmin, std::ptrdiff_t fmax,
+                      std::ptrdiff_t bmin, std::ptrdiff_t bmax,
+                      std::ptrdiff_t &xm, std::ptrdiff_t &ym)
+        {
+            std::ptrdiff_t fxy = -1, fx = xoff;
+            for (std::ptrdiff_t d = fmax; d >= fmin; d -= 2) {
+                std::ptrdiff_t x = std::min(f(d), xlim);
+                std::ptrdiff_t y = x - d;
+                if (y > ylim) {
+                    x = ylim + d;
+                    y = ylim;
+                }
+                if (x + y > fxy) {
+                    fxy = x + y;
+                    fx  = x;
+                }
+            }
+            std::ptrdiff_t bxy = PTRDIFF_MAX, bx = xlim;
+            for (std::ptrdiff_t d = bmax; d >= bmin; d -= 2) {
+                std::ptrdiff_t x = std::max(xoff, r(d));
+                std::ptrdiff_t y = x - d;
+                if (y < yoff) {
+                    x = yoff + d;
+                    y = yoff;
+                }
+                if (x + y < bxy) {
+                    bxy = x + y;
+                    bx  = x;
+                }
+            }
+            if ((xlim + ylim) - bxy < fxy - (xoff + yoff)) {
+                xm = fx;
+                ym = fxy - fx;
+            } else {
+                xm = bx;
+                ym = bxy - bx;
+            }
+        }
+
+        const std::uint32_t *a;
+        const std::uint32_t *b;
+        char *removed;
+        char *added;
+        std::size_t diagonals;
+        std::ptrdiff_t offset;
+        std::ptrdiff_t tooExpensive;
+        std::vector<std::ptrdiff_t> fd, bd;
+    };
+
+    /* Buffered output of the diff. Attribute changes are emitted as
+     * minimal transitions and only when text follows; lines end in the
+     * default attribute so colors never run past the line.
+     */
+    class diffWriter {
+    public:
+        explicit diffWriter(std::ostream &os)
+            : os(os), ansi(ansiEnabled(os.rdbuf())),
+              native(!ansi && colorize(os.rdbuf()))
+        {
+        }
+
+        ~diffWriter() { flush(); }
+
+        void write(attribute const attr, const char *data, std::size_t n)
+        {
+            if (n == 0) {
+                return;
+            }
+            setAttribute(attr);
+            buffer.append(data, n);
+            text += n;
+            if (buffer.size() >= 1 << 16) {
+                flush();
+            }
+        }
+
+        void endLine()
+        {
+            setAttribute(attribute());
+            buffer += '\n';
+            ++text;
+        }
+
+        void flush()
+        {
+            os.write(buffer.data(),
+                     static_cast<std::streamsize>(buffer.size()));
+            buffer.clear();
+            count(textBytesCounter, text);
+            count(escapeBytesCounter, escapes);
+            text = escapes = 0;
+        }
+
+    private:
+        void setAttribute(attribute const attr)
+        {
+            if (attr == state) {
+                return;
+            }
+            if (ansi) {
+                char seq[maxTransition];
+                const std::size_t n = writeTransition(state, attr, seq);
+                buffer.append(seq, n);
+                escapes += n;
+            } else if (native) {
+                // The console attribute applies to what is written after it
+                flush();
+                os << attr;
+            }
+            state = attr;
+        }
+
+        std::ostream &os;
+        const bool ansi;
+        const bool native;
+        attribute state;
+        std::string buffer;
+        std::size_t text = 0, escapes = 0;
+    };
+
+    struct diffLine {
+        const char *data;
+        std::size_t size;  // without the newline
+        bool newline;  // false for a last line without one
+    };
+
+    inline void splitLines(const char *data, std::size_t size,
+                           std::vector<diffLine> &lines)
+    {
+        const char *end = data + size;
+        while (data != end) {
+            const char *nl = static_cast<const char *>(
+              std::memchr(data, '\n', static_cast<std::size_t>(end - data)));
+            const char *stop = nl ? nl : end;
+            lines.push_back({ data, static_cast<std::size_t>(stop - data),
+                              nl != nullptr });
+            data = nl ? nl + 1 : end;
+        }
+    }
+
+    // Words are runs of letters, digits, _ and non-ASCII bytes, runs of
+    // blanks, or single other characters
+    inline void splitWords(const diffLine *lines, std::size_t count,
+                           std::vector<diffSpan> &words)
+    {
+        const auto wordChar = [](unsigned char c) {
+            return c >= 0x80 || c == '_' || (c >= '0' && c <= '9')
+              || ((c | 0x20) >= 'a' && (c | 0x20) <= 'z');
+        };
+        for (std::size_t l = 0; l < count; ++l) {
+            const char *p   = lines[l].data;
+            const char *end = p + lines[l].size;
+            while (p != end) {
+                const char *start = p;
+                const unsigned char c = static_cast<unsigned char>(*p++);
+                if (wordChar(c)) {
+                    while (p != end
+                           && wordChar(static_cast<unsigned char>(*p))) {
+                        ++p;
+                    }
+                } else if (c == ' ' || c == '\t') {
+                    while (p != end && (*p == ' ' || *p == '\t')) {
+                        ++p;
+                    }
+                }
+                words.push_back({ start, static_cast<std::size_t>(p - start) });
+            }
+            // Line breaks are words too, so changes never span lines
+            words.push_back({ nullptr, 0 });
+        }
+    }
+
+    class diffRenderer {
+    public:
+        diffRenderer(std::ostream &os, const diffOptions &options)
+            : out(os), options(options),
+              context(static_cast<std::size_t>(std::max(options.context, 0)))
+        {
+        }
+
+        // Hashes run a few lines ahead so their table slots are in cache
+        static void internLines(interner &lines,
+                                const std::vector<diffLine> &source,
+                                std::vector<std::uint32_t> &ids)
+        {
+            const std::size_t ahead = 16;
+            std::uint64_t hashes[ahead];
+            const auto hash = [&](std::size_t i) {
+                const std::uint64_t h = hashBytes(
+                  source[i].data, source[i].size + source[i].newline);
+                lines.prefetch(h);
+                hashes[i % ahead] = h;
+            };
+            for (std::size_t i = 0; i < source.size() && i < ahead; ++i) {
+                hash(i);
+            }
+            for (std::size_t i = 0; i < source.size(); ++i) {
+                const std::uint64_t h = hashes[i % ahead];
+                if (i + ahead < source.size()) {
+                    hash(i + ahead);
+                }
+                ids[i] = lines.intern(source[i].data,
+                                      source[i].size + source[i].newline, h);
+            }
+        }
+
+        bool run(const char *from, std::size_t fromSize, const char *to,
+                 std::size_t toSize)
+        {
+            splitLines(from, fromSize, a);
+            splitLines(to, toSize, b);
+            std::vector<std::uint32_t> ida(a.size()), idb(b.size());
+            interner lines;
+            lines.reserve(a.size() + b.size());
+            internLines(lines, a, ida);
+            internLines(lines, b, idb);
+            removed.assign(a.size() + 1, 0);
+            added.assign(b.size() + 1, 0);
+            if (a.size() + b.size() > anchorThreshold) {
+                anchored(ida, idb, lines.size());
+            } else {
+                myers(ida.data(), ida.size(), idb.data(), idb.size(),
+                      removed.data(), added.data());
+            }
+            return render();
+        }
+
+    private:
+        struct change {
+            std::size_t a0, a1, b0, b1;
+        };
+
+        static constexpr std::size_t anchorThreshold = 8192;
+
+        /* Myers takes time proportional to the input size times the number
+         * of edits, too slow for large inputs with scattered changes. These
+         * are first cut at lines occurring exactly once on either side,
+         * keeping the longest run of them in the same order on both sides,
+         * and only the stretches between those anchors are diffed.
+         */
+        void anchored(const std::vector<std::uint32_t> &ida,
+                      const std::vector<std::uint32_t> &idb, std::size_t ids)
+        {
+            const std::uint32_t none = UINT32_MAX;
+            std::vector<std::uint32_t> inA(ids, none), inB(ids, none);
+            for (std::size_t i = 0; i < ida.size(); ++i) {
+                std::uint32_t &slot = inA[ida[i]];
+                slot = slot == none ? static_cast<std::uint32_t>(i) : none - 1;
+            }
+            for (std::size_t j = 0; j < idb.size(); ++j) {
+                std::uint32_t &slot = inB[idb[j]];
+                slot = slot == none ? static_cast<std::uint32_t>(j) : none - 1;
+            }
+
+            // Longest increasing subsequence of the unique pairs by b
+            std::vector<std::uint32_t> pairA, pairB;
+            for (std::size_t i = 0; i < ida.size(); ++i) {
+                const std::uint32_t j = inB[ida[i]];
+                if (inA[ida[i]] == i && j < none - 1) {
+                    pairA.push_back(static_cast<std::uint32_t>(i));
+                    pairB.push_back(j);
+                }
+            }
+            std::vector<std::uint32_t> tails, previous(pairA.size());
+            for (std::uint32_t k = 0; k < pairA.size(); ++k) {
+                const auto at = std::lower_bound(
+                  tails.begin(), tails.end(), pairB[k],
+                  [&](std::uint32_t t, std::uint32_t j) {
+                      return pairB[t] < j;
+                  });
+                previous[k] = at == tails.begin() ? none : *(at - 1);
+                if (at == tails.end()) {
+                    tails.push_back(k);
+                } else {
+                    *at = k;
+                }
+            }
+            std::vector<std::uint32_t> anchors(tails.size());
+            std::uint32_t k = tails.empty() ? none : tails.back();
+            for (std::size_t n = anchors.size(); n != 0; k = previous[k]) {
+                anchors[--n] = k;
+            }
+
+            std::size_t x = 0, y = 0;
+            for (std::size_t n = 0; n <= anchors.size(); ++n) {
+                const std::size_t xe
+                  = n < anchors.size() ? pairA[anchors[n]] : ida.size();
+                const std::size_t ye
+                  = n < anchors.size() ? pairB[anchors[n]] : idb.size();
+                if (x != xe || y != ye) {
+                    myers(ida.data() + x, xe - x, idb.data() + y, ye - y,
+                          removed.data() + x, added.data() + y);
+                }
+                x = xe + 1;
+                y = ye + 1;
+            }
+        }
+
+        bool render()
+        {
+            // Maximal runs of changed lines, with their position in both
+            std::vector<change> changes;
+            std::size_t i = 0, j = 0;
+            while (i < a.size() || j < b.size()) {
+                if (!removed[i] && !added[j]) {
+                    ++i;
+                    ++j;
+                    continue;
+                }
+                change c = { i, i, j, j };
+                while (removed[i]) {
+                    ++i;
+                }
+                while (added[j]) {
+                    ++j;
+                }
+                c.a1 = i;
+                c.b1 = j;
+                changes.push_back(c);
+            }
+            if (changes.empty()) {
+                return false;
+            }
+
+            const diffStyle &colors = options.colors;
+            header("--- ", options.fromName);
+            header("+++ ", options.toName);
+            for (std::size_t first = 0; first < changes.size();) {
+                // Changes closer than twice the context share a hunk
+                std::size_t last = first;
+                while (last + 1 < changes.size()
+                       && changes[last + 1].a0 - changes[last].a1
+                         <= 2 * context) {
+                    ++last;
+                }
+                const change &c0 = changes[first];
+                const change &c1 = changes[last];
+                const std::size_t lead = std::min(context, c0.a0);
+                const std::size_t trail
+                  = std::min(context, a.size() - c1.a1);
+                hunkHeader(c0.a0 - lead, c1.a1 + trail, c0.b0 - lead,
+                           c1.b1 + trail);
+                for (std::size_t k = first; k <= last; ++k) {
+                    const change &c = changes[k];
+                    const std::size_t from
+                      = k == first ? c.a0 - lead : changes[k - 1].a1;
+                    for (std::size_t l = from; l < c.a0; ++l) {
+                        line(' ', attribute(), a[l]);
+                    }
+                    if (!options.words || c.a0 == c.a1 || c.b0 == c.b1
+                        || !words(c)) {
+                        for (std::size_t l = c.a0; l < c.a1; ++l) {
+                            line('-', colors.removed, a[l]);
+                        }
+                        for (std::size_t l = c.b0; l < c.b1; ++l) {
+                            line('+', colors.added, b[l]);
+                        }
+                    }
+                }
+                for (std::size_t l = c1.a1; l < c1.a1 + trail; ++l) {
+                    line(' ', attribute(), a[l]);
+                }
+                first = last + 1;
+            }
+            out.flush();
+            return true;
+        }
+
+        void header(const char *prefix, const std::string &name)
+        {
+            out.write(options.colors.header, prefix, 4);
+            out.write(options.colors.header, name.data(), name.size());
+            out.endLine();
+        }
+
+        void hunkHeader(std::size_t a0, std::size_t a1, std::size_t b0,
+                        std::size_t b1)
+        {
+            // Empty ranges are numbered by the line before them
+            char text[96];
+            const int n = std::snprintf(
+              text, sizeof(text), "@@ -%lu,%lu +%lu,%lu @@",
+              static_cast<unsigned long>(a1 > a0 ? a0 + 1 : a0),
+              static_cast<unsigned long>(a1 - a0),
+              static_cast<unsigned long>(b1 > b0 ? b0 + 1 : b0),
+              static_cast<unsigned long>(b1 - b0));
+            out.write(options.colors.hunk, text, static_cast<std::size_t>(n));
+            out.endLine();
+        }
+
+        void line(char prefix, attribute const attr, const diffLine &l)
+        {
+            out.write(attr, &prefix, 1);
+            out.write(attr, l.data, l.size);
+            endLine(l);
+        }
+
+        void endLine(const diffLine &l)
+        {
+            out.endLine();
+            if (!l.newline) {
+                static const char note[] = "\\ No newline at end of file";
+                out.write(attribute(), note, sizeof(note) - 1);
+                out.endLine();
+            }
+        }
+
+        /* Removed and added lines of c with the changed words highlighted.
+         * Returns false, writing nothing, for blocks too large to compare.
+         */
+        bool words(const change &c)
+        {
+            static constexpr std::size_t maxBlock = 1 << 16;
+            std::size_t bytes = 0;
+            for (std::size_t l = c.a0; l < c.a1; ++l) {
+                bytes += a[l].size;
+            }
+            for (std::size_t l = c.b0; l < c.b1; ++l) {
+                bytes += b[l].size;
+            }
+            if (bytes > maxBlock) {
+                return false;
+            }
+
+            std::vector<diffSpan> wa, wb;
+            splitWords(&a[c.a0], c.a1 - c.a0, wa);
+            splitWords(&b[c.b0], c.b1 - c.b0, wb);
+            std::vector<std::uint32_t> ida(wa.size()), idb(wb.size());
+            interner tokens;
+            tokens.reserve(wa.size() + wb.size());
+            for (std::size_t i = 0; i < wa.size(); ++i) {
+                ida[i] = wa[i].data ? tokens.intern(wa[i].data, wa[i].size)
+                                    : UINT32_MAX;
+            }
+            for (std::size_t j = 0; j < wb.size(); ++j) {
+                idb[j] = wb[j].data ? tokens.intern(wb[j].data, wb[j].size)
+                                    : UINT32_MAX;
+            }
+            std::vector<char> ra(wa.size() + 1), rb(wb.size() + 1);
+            myers(ida.data(), ida.size(), idb.data(), idb.size(), ra.data(),
+                  rb.data());
+
+            const diffStyle &colors = options.colors;
+            wordLines('-', colors.removed, colors.removedWord, &a[c.a0], wa,
+                      ra);
+            wordLines('+', colors.added, colors.addedWord, &b[c.b0], wb, rb);
+            return true;
+        }
+
+        void wordLines(char prefix, attribute const attr,
+                       attribute const changed, const diffLine *lines,
+                       const std::vector<diffSpan> &words,
+                       const std::vector<char> &flags)
+        {
+            bool start = true;
+            for (std::size_t w = 0; w < words.size(); ++w) {
+                if (start) {
+                    out.write(attr, &prefix, 1);
+                    start = false;
+                }
+                if (words[w].data) {
+                    out.write(flags[w] ? changed : attr, words[w].data,
+                              words[w].size);
+                } else {
+                    endLine(*lines++);
+                    start = true;
+                }
+            }
+        }
+
+        diffWriter out;
+        const diffOptions &options;
+        const std::size_t context;
+        std::vector<diffLine> a, b;
+        std::vector<char> removed, added;
+    };
+
+}  // namespace rang_implementation
+
+/* Write a unified diff of two texts to os, with changed lines colored and
+ * changed words inside them highlighted. Returns whether they differ.
+ */
+inline bool diff(std::ostream &os, const char *from, std::size_t fromSize,
+                 const char *to, std::size_t toSize,
+                 const diffOptions &options = diffOptions())
+{
+    return rang_implementation::diffRenderer(os, options)
+      .run(from, fromSize, to, toSize);
+}
+
+inline bool diff(std::ostream &os, const std::string &from,
+                 const std::string &to,
+                 const diffOptions &options = diffOptions())
+{
+    return diff(os, from.data(), from.size(), to.data(), to.size(), options);
+}
+
+}  // namespace rang
+
+#endif /* ifndef RANG_DIFF_DOT_HPP */
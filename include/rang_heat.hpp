@@ -0,0 +1,280 @@
+#ifndef RANG_HEAT_DOT_HPP
+#define RANG_HEAT_DOT_HPP
+
+#include "rang.hpp"
+
+#include <cmath>
+#include <cstdio>
+#include <initializer_list>
+#include <limits>
+#include <type_traits>
+
+namespace rang {
+
+/* Value to attribute mapping built once from thresholds. A value takes the
+ * attribute of the highest threshold it reaches; values below the first
+ * one, and NaN, are printed without color. The escapes of every step are
+ * rendered up front.
+ */
+class heatScale {
+public:
+    struct step {
+        double threshold;
+        attribute attr;
+    };
+
+    // Up to maxSteps steps in ascending order of threshold
+    static constexpr std::size_t maxSteps = 15;
+
+    heatScale(std::initializer_list<step> steps) noexcept
+    {
+        for (std::size_t i = 0; i < slots; ++i) {
+            bounds[i] = std::numeric_limits<double>::infinity();
+            sequence[i][0] = 0;
+        }
+        bounds[0] = -std::numeric_limits<double>::infinity();
+        std::size_t i = 1;
+        for (const step &s : steps) {
+            if (i == slots) {
+                break;
+            }
+            bounds[i] = s.threshold;
+            attrs[i]  = s.attr;
+            sequence[i][0] = static_cast<char>(
+              rang_implementation::writeTransition(attribute(), s.attr,
+                                                   sequence[i] + 1));
+            ++i;
+        }
+    }
+
+    // Slot of value, 0 when no threshold is reached
+    std::size_t find(double value) const noexcept
+    {
+        // Fixed depth search compiling to conditional moves
+        std::size_t i = 0;
+        for (std::size_t half = slots / 2; half != 0; half /= 2) {
+            i += bounds[i + half] <= value ? half : 0;
+        }
+        return i;
+    }
+
+    attribute at(double value) const noexcept { return attrs[find(value)]; }
+
+private:
+    template <typename T>
+    friend class heatValue;
+
+    static constexpr std::size_t slots = maxSteps + 1;
+
+    double bounds[slots];
+    attribute attrs[slots];
+    // Length prefixed escapes opening each slot's attribute
+    char sequence[slots][rang_implementation::maxTransition + 1];
+};
+
+namespace rang_implementation {
+
+    inline char *writeUnsigned(char *out, unsigned long long value) noexcept
+    {
+        char digits[20];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        while (n != 0) {
+            *out++ = digits[--n];
+        }
+        return out;
+    }
+
+    template <typename T>
+    inline bool negative(T const value, std::true_type) noexcept
+    {
+        return value < 0;
+    }
+
+    template <typename T>
+    inline bool negative(T const, std::false_type) noexcept
+    {
+        return false;
+    }
+
+    template <typename T>
+    inline typename std::enable_if<std::is_integral<T>::value, char *>::type
+    writeNumber(char *out, T const value, int) noexcept
+    {
+        unsigned long long magnitude = static_cast<unsigned long long>(value);
+        if (negative(value, std::is_signed<T>())) {
+            *out++    = '-';
+            magnitude = 0ull - magnitude;
+        }
+        return writeUnsigned(out, magnitude);
+    }
+
+    // Fixed notation with the given number of decimals, at most 9. out
+    // must hold 400 chars.
+    template <typename T>
+    inline
+      typename std::enable_if<std::is_floating_point<T>::value, char *>::type
+      writeNumber(char *out, T const value, int decimals) noexcept
+    {
+        static const double scales[10]
+          = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9 };
+        decimals = std::min(std::max(decimals, 0), 9);
+        const double scaled
+          = std::fabs(static_cast<double>(value)) * scales[decimals];
+        if (!(scaled < 1e18)) {
+            // Huge values, infinity and NaN take the slow path
+            return out
+              + std::snprintf(out, 400, "%.*f", decimals,
+                              static_cast<double>(value));
+        }
+        const unsigned long long units
+          = static_cast<unsigned long long>(scaled + 0.5);
+        if (std::signbit(value) && units != 0) {
+            *out++ = '-';
+        }
+        const unsigned long long divisor
+          = static_cast<unsigned long long>(scales[decimals]);
+        out = writeUnsigned(out, units / divisor);
+        if (decimals != 0) {
+            *out++ = '.';
+            char *end = out + decimals;
+            unsigned long long fraction = units % divisor;
+            for (char *p = end; p != out;) {
+                *--p = static_cast<char>('0' + fraction % 10);
+                fraction /= 10;
+            }
+            out = end;
+        }
+        return out;
+    }
+
+}  // namespace rang_implementation
+
+// Number bound to a heatScale, created by heat()
+template <typename T>
+class heatValue {
+public:
+    heatValue(T const value, const heatScale &scale, int decimals) noexcept
+        : value(value), scale(scale), decimals(decimals)
+    {
+    }
+
+    friend std::ostream &operator<<(std::ostream &os, const heatValue &heat)
+    {
+        heat.write(os);
+        return os;
+    }
+
+private:
+    // Padding up to this many chars goes out in the same write as the number
+    enum { inlinePad = 64 };
+
+    void write(std::ostream &os) const
+    {
+        using namespace rang_implementation;
+        const std::ostream::sentry ok(os);
+        if (!ok) {
+            return;
+        }
+        // Escapes, number and padding: 64 + 2 + 330 + 9 chars at most
+        char buffer[512];
+        char number[400];
+        const std::size_t size = static_cast<std::size_t>(
+          writeNumber(number, value, decimals) - number);
+        const std::size_t slot = scale.find(static_cast<double>(value));
+        const std::size_t width
+          = os.width() > 0 ? static_cast<std::size_t>(os.width()) : 0;
+        const std::size_t pad = width > size ? width - size : 0;
+        const bool left       = (os.flags() & std::ios_base::adjustfield)
+          == std::ios_base::left;
+        os.width(0);
+
+        if (slot == 0 || !ansiEnabled(os.rdbuf())) {
+            // No escapes, or a native console styled by the operators
+            if (!left) {
+                padding(os, pad);
+            }
+            if (slot != 0) {
+                os << scale.attrs[slot];
+            }
+            put(os, number, size);
+            if (slot != 0) {
+                os << style::reset;
+            }
+            if (left) {
+                padding(os, pad);
+            }
+            count(textBytesCounter, size);
+            return;
+        }
+
+        // Padding stays outside the colored number
+        const char *open        = scale.sequence[slot] + 1;
+        const std::size_t codes = static_cast<std::size_t>(open[-1]);
+        const bool joined       = pad <= inlinePad;
+        char *p                 = buffer;
+        if (!left) {
+            if (joined) {
+                p = std::fill_n(p, pad, os.fill());
+            } else {
+                padding(os, pad);
+            }
+        }
+        p = std::copy(open, open + codes, p);
+        p = std::copy(number, number + size, p);
+        p = std::copy("\033[0m", "\033[0m" + 4, p);
+        if (left && joined) {
+            p = std::fill_n(p, pad, os.fill());
+        }
+        put(os, buffer, static_cast<std::size_t>(p - buffer));
+        if (left && !joined) {
+            padding(os, pad);
+        }
+
+        count(textBytesCounter, size);
+        count(escapeBytesCounter, codes + 4);
+    }
+
+    // Write into the stream buffer, setting badbit when it takes less
+    static void put(std::ostream &os, const char *data, std::size_t size)
+    {
+        if (os && os.rdbuf()->sputn(data, static_cast<std::streamsize>(size))
+              != static_cast<std::streamsize>(size)) {
+            os.setstate(std::ios_base::badbit);
+        }
+    }
+
+    static void padding(std::ostream &os, std::size_t pad)
+    {
+        char fill[inlinePad];
+        std::fill_n(fill, std::min<std::size_t>(pad, inlinePad), os.fill());
+        while (pad != 0 && os) {
+            const std::size_t n = std::min<std::size_t>(pad, inlinePad);
+            put(os, fill, n);
+            pad -= n;
+        }
+    }
+
+    T value;
+    const heatScale &scale;
+    int decimals;
+};
+
+/* Print value colored by the scale in a single write. Floating point
+ * values are printed in fixed notation with the given decimals.
+ */
+template <typename T>
+inline typename std::enable_if<std::is_arithmetic<T>::value
+                                 && !std::is_same<T, bool>::value,
+                               heatValue<T>>::type
+heat(T const value, const heatScale &scale, int decimals = 0) noexcept
+{
+    return heatValue<T>(value, scale, decimals);
+}
+
+}  // namespace rang
+
+#endif /* ifndef RANG_HEAT_DOT_HPP */
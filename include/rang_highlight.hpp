@@ -0,0 +1,436 @@
+#ifndef RANG_HIGHLIGHT_DOT_HPP
+#define RANG_HIGHLIGHT_DOT_HPP
+
+#include "rang.hpp"
+
+#include <cstdint>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace rang {
+
+/* A set of literal patterns, each wrapped in a rang attribute when found.
+ * Patterns are compiled into an Aho-Corasick automaton over byte classes;
+ * overlapping matches resolve leftmost-longest, like grep --color.
+ * Call compile() before sharing one highlighter between threads.
+ */
+class highlighter {
+public:
+    template <typename T>
+    typename std::enable_if<rang_implementation::isAttribute<T>::value,
+                            highlighter &>::type
+    add(std::string pattern, T const value)
+    {
+        if (!pattern.empty()) {
+            patterns.push_back({ std::move(pattern),
+                                 rang_implementation::openSequence(value),
+                                 rang_implementation::closeSequence(value) });
+            compiled = false;
+        }
+        return *this;
+    }
+
+    void compile()
+    {
+        if (compiled) {
+            return;
+        }
+        buildClasses();
+        buildAutomaton();
+        compiled = true;
+    }
+
+    bool empty() const noexcept { return patterns.empty(); }
+
+private:
+    friend class highlightBuf;
+
+    struct pattern {
+        std::string text;
+        std::string open;
+        std::string close;
+    };
+
+    void buildClasses()
+    {
+        // Bytes absent from every pattern share class 0, which keeps the
+        // transition table narrow even with hundreds of patterns
+        std::fill(std::begin(byteClass), std::end(byteClass), 0);
+        bool startByte[256] = {};
+        startPairs.assign(1 << 16, 0);
+        numClasses = 1;
+        for (const pattern &p : patterns) {
+            const unsigned char first = static_cast<unsigned char>(p.text[0]);
+            startByte[first]          = true;
+            // One byte patterns start with any pair beginning with them
+            for (unsigned second = 0; second < 256; ++second) {
+                if (p.text.size() == 1
+                    || second == static_cast<unsigned char>(p.text[1])) {
+                    startPairs[first << 8 | second] = 1;
+                }
+            }
+            for (const char c : p.text) {
+                std::uint16_t &cls
+                  = byteClass[static_cast<unsigned char>(c)];
+                if (cls == 0) {
+                    cls = static_cast<std::uint16_t>(numClasses++);
+                }
+            }
+        }
+        startCount = 0;
+        for (int c = 0; c < 256; ++c) {
+            if (startByte[c] && startCount++ < maxSearched) {
+                starts[startCount - 1] = static_cast<char>(c);
+            }
+        }
+    }
+
+    // Whether a pattern may start with bytes a and b
+    bool startPair(char const a, char const b) const noexcept
+    {
+        return startPairs[static_cast<unsigned char>(a) << 8
+                          | static_cast<unsigned char>(b)]
+          != 0;
+    }
+
+    void buildAutomaton()
+    {
+        next.assign(numClasses, 0);
+        depth.assign(1, 0);
+        output.assign(1, -1);
+
+        // Trie of all patterns, 0 in next means "no edge yet"
+        for (std::size_t id = 0; id < patterns.size(); ++id) {
+            std::int32_t state = 0;
+            for (const char c : patterns[id].text) {
+                const std::size_t cls
+                  = byteClass[static_cast<unsigned char>(c)];
+                std::int32_t &edge = next[state * numClasses + cls];
+                if (edge == 0) {
+                    edge = static_cast<std::int32_t>(depth.size());
+                    next.resize(next.size() + numClasses, 0);
+                    depth.push_back(depth[state] + 1);
+                    output.push_back(-1);
+                }
+                state = next[state * numClasses + cls];
+            }
+            // Keep the first of duplicate patterns
+            if (output[state] < 0) {
+                output[state] = static_cast<std::int32_t>(id);
+            }
+        }
+
+        // Breadth first completion of failure links into a dense DFA
+        std::vector<std::int32_t> fail(depth.size(), 0);
+        std::queue<std::int32_t> pending;
+        for (std::size_t cls = 0; cls < numClasses; ++cls) {
+            if (next[cls] != 0) {
+                pending.push(next[cls]);
+            }
+        }
+        while (!pending.empty()) {
+            const std::int32_t state = pending.front();
+            pending.pop();
+            // The longest output of a state may come through its suffix
+            if (output[state] < 0) {
+                output[state] = output[fail[state]];
+            }
+            for (std::size_t cls = 0; cls < numClasses; ++cls) {
+                std::int32_t &edge = next[state * numClasses + cls];
+                const std::int32_t fallback
+                  = next[fail[state] * numClasses + cls];
+                if (edge != 0) {
+                    fail[edge] = fallback;
+                    pending.push(edge);
+                } else {
+                    edge = fallback;
+                }
+            }
+        }
+    }
+
+    std::vector<pattern> patterns;
+    std::vector<std::int32_t> next;  // state * numClasses + byte class
+    std::vector<std::int32_t> depth;  // longest pattern prefix at state
+    std::vector<std::int32_t> output;  // longest pattern ending at state
+    std::uint16_t byteClass[256] = {};  // up to 257 classes with class 0
+    std::vector<unsigned char> startPairs;  // by first two bytes
+    std::size_t numClasses = 1;
+    // Start bytes are searched with memchr when there are at most
+    // maxSearched of them, otherwise two byte windows are looked up
+    static constexpr int maxSearched = 3;
+    int startCount                   = 0;
+    char starts[maxSearched]         = {};
+    bool compiled                    = false;
+};
+
+/* Streaming filter that wraps every pattern match in its escapes before
+ * forwarding to the underlying stream. A match may span any number of
+ * writes: bytes which could still belong to a match are held back until
+ * the match is decided, at most the length of the longest pattern.
+ * flush() forwards everything decided so far; finish() (or destruction)
+ * decides and forwards the remainder.
+ */
+class highlightBuf : public std::streambuf {
+public:
+    highlightBuf(std::ostream &os, highlighter &hl)
+        : highlightBuf(os.rdbuf(), hl,
+                       rang_implementation::ansiEnabled(os.rdbuf()))
+    {
+    }
+
+    highlightBuf(std::streambuf *sink, highlighter &hl, bool color)
+        : sink(sink), hl(hl), color(color && !hl.empty())
+    {
+        hl.compile();
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    highlightBuf(const highlightBuf &) = delete;
+    highlightBuf &operator=(const highlightBuf &) = delete;
+
+    ~highlightBuf() override { finish(); }
+
+    // Decide pending matches as if the input ended here
+    void finish()
+    {
+        drain();
+        if (!color) {
+            return;
+        }
+        while (true) {
+            scan();
+            if (!hasCandidate) {
+                break;
+            }
+            commit();
+        }
+        write(pending.data() + emitted, pending.size() - emitted);
+        pending.clear();
+        std::fill(std::begin(nextHit), std::end(nextHit), 0);
+        emitted = scanned = 0;
+        state             = 0;
+        sink->pubsync();
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        drain();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        if (n <= epptr() - pptr()) {
+            std::memcpy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+        } else {
+            drain();
+            feed(s, static_cast<std::size_t>(n));
+        }
+        return n;
+    }
+
+    int sync() override
+    {
+        drain();
+        return sink->pubsync();
+    }
+
+private:
+    void drain()
+    {
+        if (pptr() != pbase()) {
+            feed(pbase(), static_cast<std::size_t>(pptr() - pbase()));
+            setp(buffer, buffer + sizeof(buffer));
+        }
+    }
+
+    void feed(const char *s, std::size_t n)
+    {
+        if (!color) {
+            write(s, n);
+            return;
+        }
+        pending.append(s, n);
+        scan();
+
+        // Forward what no future match can claim and compact the window
+        std::size_t safe = scanned - static_cast<std::size_t>(hl.depth[state]);
+        if (hasCandidate && candStart < safe) {
+            safe = candStart;
+        }
+        if (safe > emitted) {
+            write(pending.data() + emitted, safe - emitted);
+            emitted = safe;
+        }
+        pending.erase(0, emitted);
+        for (std::size_t &hit : nextHit) {
+            hit = hit > emitted ? hit - emitted : 0;
+        }
+        scanned -= emitted;
+        candStart -= hasCandidate ? emitted : 0;
+        candEnd -= hasCandidate ? emitted : 0;
+        emitted = 0;
+    }
+
+    void scan()
+    {
+        const std::int32_t *next  = hl.next.data();
+        const std::int32_t *depth = hl.depth.data();
+        const std::int32_t *out   = hl.output.data();
+        const std::uint16_t *cls  = hl.byteClass;
+        const std::size_t width   = hl.numClasses;
+        const char *data          = pending.data();
+        const std::size_t size    = pending.size();
+
+        while (scanned < size) {
+            if (state == 0 && !hasCandidate) {
+                scanned = skipToStart(data, scanned, size);
+                if (scanned == size) {
+                    break;
+                }
+            }
+            const unsigned char c = static_cast<unsigned char>(data[scanned++]);
+            state                 = next[state * width + cls[c]];
+
+            const std::int32_t id = out[state];
+            if (id >= 0) {
+                const std::size_t start = scanned - hl.patterns[id].text.size();
+                if (!hasCandidate || start < candStart
+                    || (start == candStart && scanned > candEnd)) {
+                    hasCandidate = true;
+                    candStart    = start;
+                    candEnd      = scanned;
+                    candId       = id;
+                }
+            }
+            // Every later match starts at or after scanned - depth
+            if (hasCandidate
+                && candStart + static_cast<std::size_t>(depth[state])
+                  < scanned) {
+                commit();
+            }
+        }
+    }
+
+    // First position from on where a pattern may start, size if none
+    std::size_t skipToStart(const char *data, std::size_t from,
+                            std::size_t size) noexcept
+    {
+        // memchr pays off while start bytes are rare; once its hits keep
+        // failing the pair check close together, windows are checked
+        // directly
+        const std::size_t begin = from;
+        std::size_t rejected    = 0;
+        while (hl.startCount <= highlighter::maxSearched
+               && (rejected < 4 || from - begin >= rejected * 64)) {
+            from = nextStartByte(data, from, size);
+            if (from + 1 >= size || hl.startPair(data[from], data[from + 1])) {
+                return from;
+            }
+            ++from;
+            ++rejected;
+        }
+        return nextStartPair(data, from, size);
+    }
+
+    std::size_t nextStartByte(const char *data, std::size_t from,
+                              std::size_t size) noexcept
+    {
+        // Each byte's next hit is kept, so every search resumes where the
+        // previous one stopped instead of rescanning past the nearest hit
+        std::size_t nearest = size;
+        for (int i = 0; i < hl.startCount; ++i) {
+            std::size_t &hit = nextHit[i];
+            hit              = std::max(hit, from);
+            if (hit < size && data[hit] != hl.starts[i]) {
+                const void *found
+                  = std::memchr(data + hit, hl.starts[i], size - hit);
+                hit = found ? static_cast<std::size_t>(
+                                static_cast<const char *>(found) - data)
+                            : size;
+            }
+            nearest = std::min(nearest, hit);
+        }
+        return nearest;
+    }
+
+    std::size_t nextStartPair(const char *data, std::size_t from,
+                              std::size_t size) const noexcept
+    {
+        const unsigned char *pairs = hl.startPairs.data();
+        const unsigned char *p
+          = reinterpret_cast<const unsigned char *>(data);
+        const auto at = [&](std::size_t i) {
+            return pairs[p[i] << 8 | p[i + 1]];
+        };
+        // Eight windows per branch, then find the one within them
+        while (from + 9 <= size) {
+            if (at(from) | at(from + 1) | at(from + 2) | at(from + 3)
+                | at(from + 4) | at(from + 5) | at(from + 6) | at(from + 7)) {
+                break;
+            }
+            from += 8;
+        }
+        while (from + 1 < size && !at(from)) {
+            ++from;
+        }
+        return from;
+    }
+
+    void commit()
+    {
+        const highlighter::pattern &p = hl.patterns[candId];
+        write(pending.data() + emitted, candStart - emitted);
+        writeEscape(p.open);
+        write(pending.data() + candStart, candEnd - candStart);
+        writeEscape(p.close);
+        emitted = scanned = candEnd;
+        state             = 0;
+        hasCandidate      = false;
+    }
+
+    void write(const char *s, std::size_t n)
+    {
+        if (n != 0) {
+            rang_implementation::count(rang_implementation::textBytesCounter,
+                                       n);
+            sink->sputn(s, static_cast<std::streamsize>(n));
+        }
+    }
+
+    void writeEscape(const std::string &sequence)
+    {
+        rang_implementation::count(rang_implementation::escapeBytesCounter,
+                                   sequence.size());
+        sink->sputn(sequence.data(),
+                    static_cast<std::streamsize>(sequence.size()));
+    }
+
+    std::streambuf *sink;
+    highlighter &hl;
+    const bool color;
+    char buffer[4096];
+
+    std::string pending;  // bytes not yet forwarded
+    std::size_t emitted = 0;  // pending[0, emitted) is already forwarded
+    std::size_t scanned = 0;  // pending[0, scanned) went through the DFA
+    std::int32_t state  = 0;
+    bool hasCandidate   = false;
+    std::size_t candStart = 0, candEnd = 0;
+    std::int32_t candId = 0;
+    // Next position of each searched start byte, or the end of the bytes
+    // searched so far
+    std::size_t nextHit[highlighter::maxSearched] = {};
+};
+
+}  // namespace rang
+
+#endif /* ifndef RANG_HIGHLIGHT_DOT_HPP */
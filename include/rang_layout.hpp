@@ -0,0 +1,420 @@
+#ifndef RANG_LAYOUT_DOT_HPP
+#define RANG_LAYOUT_DOT_HPP
+
+#include "rang_markup.hpp"
+
+#include <chrono>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace rang {
+
+// What a layout prints for one log line
+struct logEvent {
+    std::chrono::system_clock::time_point time;
+    int level;
+    std::uint64_t thread;
+    const char *logger;
+    std::size_t loggerSize;
+    const char *message;
+    std::size_t messageSize;
+
+    // Stamped with the current time and thread
+    logEvent(int level, const char *logger, const char *message) noexcept
+        : logEvent(level, logger, std::strlen(logger), message,
+                   std::strlen(message))
+    {
+    }
+
+    logEvent(int level, const std::string &logger,
+             const std::string &message) noexcept
+        : logEvent(level, logger.data(), logger.size(), message.data(),
+                   message.size())
+    {
+    }
+
+    logEvent(int level, const char *logger, std::size_t loggerSize,
+             const char *message, std::size_t messageSize) noexcept
+        : time(std::chrono::system_clock::now()), level(level),
+          thread(std::hash<std::thread::id>()(std::this_thread::get_id())),
+          logger(logger), loggerSize(loggerSize), message(message),
+          messageSize(messageSize)
+    {
+    }
+};
+
+/* Log line layout compiled from a pattern into a flat list of ops with
+ * pre-rendered escapes. Fields:
+ *
+ *   %t  UTC timestamp, 2026-01-31 23:59:59.999
+ *   %L  level name
+ *   %T  thread id
+ *   %n  logger name
+ *   %m  message
+ *   %%  a percent sign
+ *
+ * A field may be followed by {names} with the names markup takes, or by
+ * {level} for the attribute of the event's level:
+ *
+ *   "%t{dim} %L{level} [%n{cyan}] %m"
+ *
+ * A compiled layout is never modified, so one instance can be shared by
+ * any number of threads.
+ */
+class layout {
+public:
+    struct level {
+        int value;
+        const char *name;
+        attribute attr;
+    };
+
+    layout(const char *pattern, std::initializer_list<level> levels)
+    {
+        add("\033[0m", 4);
+        for (const level &l : levels) {
+            levelEntry entry;
+            entry.value = l.value;
+            entry.name  = add(l.name, std::strlen(l.name));
+            entry.open  = addOpen(l.attr);
+            entry.attr  = l.attr;
+            this->levels.push_back(entry);
+            maxLevelName = std::max<std::size_t>(maxLevelName, entry.name.size);
+            maxLevelOpen = std::max<std::size_t>(maxLevelOpen, entry.open.size);
+        }
+        compile(pattern);
+    }
+
+    /* Append the line for event, ending in a newline, to out. Escapes are
+     * only written when color is set.
+     */
+    void format(std::string &out, const logEvent &event, bool color) const
+    {
+        const std::size_t start = out.size();
+        std::size_t escapes     = 0;
+        out.resize(start + bound(event));
+        const auto style = [&](char *&p, attribute, slice open) {
+            if (color) {
+                std::memcpy(p, pool.data() + open.offset, open.size);
+                p += open.size;
+                escapes += open.size;
+            }
+        };
+        const char *end = run(&out[start], event, style);
+        out.resize(static_cast<std::size_t>(end - out.data()));
+        rang_implementation::count(rang_implementation::textBytesCounter,
+                                   out.size() - start - escapes);
+        rang_implementation::count(rang_implementation::escapeBytesCounter,
+                                   escapes);
+    }
+
+    // Write the line for event to os in a single write
+    void write(std::ostream &os, const logEvent &event) const
+    {
+        static thread_local std::string line;
+        line.clear();
+        // Decided once per line: escapes, console calls or plain text
+        std::streambuf *buf = os.rdbuf();
+        const bool color    = rang_implementation::colorize(buf);
+        if (color && !rang_implementation::ansiOutput(buf)) {
+            // Native console: text is flushed before each attribute change
+            line.resize(bound(event));
+            char *const base = &line[0];
+            char *end = run(base, event, [&](char *&p, attribute attr, slice) {
+                os.write(base, p - base);
+                p = base;
+                rang_implementation::setAttribute(os, attr);
+            });
+            line.resize(static_cast<std::size_t>(end - base));
+        } else {
+            format(line, event, color);
+        }
+        os.write(line.data(), static_cast<std::streamsize>(line.size()));
+    }
+
+    std::size_t size() const noexcept { return ops.size(); }
+
+private:
+    enum class field : unsigned char {
+        text,
+        time,
+        levelName,
+        thread,
+        logger,
+        message
+    };
+
+    struct slice {
+        std::uint32_t offset;
+        std::uint32_t size;
+    };
+
+    struct op {
+        field kind;
+        bool byLevel;  // styled with the event's level attribute
+        slice text;  // static text of text ops
+        slice open;  // escape opening the field, empty if unstyled
+        attribute attr;
+    };
+
+    struct levelEntry {
+        int value;
+        slice name;
+        slice open;
+        attribute attr;
+    };
+
+    // Longest line event can produce
+    std::size_t bound(const logEvent &event) const noexcept
+    {
+        return fixedBound + loggerFields * event.loggerSize
+          + messageFields * event.messageSize;
+    }
+
+    // Write the line to out, which must hold bound() chars, returns its end
+    template <typename Style>
+    char *run(char *out, const logEvent &event, Style &&style) const
+    {
+        const slice close       = { 0, 4 };  // "\033[0m" starts the pool
+        const levelEntry *entry = find(event.level);
+        const char *data        = pool.data();
+        for (const op &o : ops) {
+            slice open     = o.open;
+            attribute attr = o.attr;
+            if (o.byLevel) {
+                open = entry ? entry->open : slice{ 0, 0 };
+                attr = entry ? entry->attr : attribute();
+            }
+            if (open.size != 0) {
+                style(out, attr, open);
+            }
+            switch (o.kind) {
+                case field::text:
+                    out = std::copy(data + o.text.offset,
+                                    data + o.text.offset + o.text.size, out);
+                    break;
+                case field::time: out = writeTime(out, event.time); break;
+                case field::levelName:
+                    if (entry) {
+                        out = std::copy(data + entry->name.offset,
+                                        data + entry->name.offset
+                                          + entry->name.size,
+                                        out);
+                    } else {
+                        out = writeSigned(out, event.level);
+                    }
+                    break;
+                case field::thread:
+                    out = writeNumber(out, event.thread);
+                    break;
+                case field::logger:
+                    out = std::copy(event.logger,
+                                    event.logger + event.loggerSize, out);
+                    break;
+                case field::message:
+                    out = std::copy(event.message,
+                                    event.message + event.messageSize, out);
+                    break;
+            }
+            if (open.size != 0) {
+                style(out, attribute(), close);
+            }
+        }
+        *out++ = '\n';
+        return out;
+    }
+
+    const levelEntry *find(int value) const noexcept
+    {
+        for (const levelEntry &entry : levels) {
+            if (entry.value == value) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    void compile(const char *p)
+    {
+        while (*p != 0) {
+            if (*p != '%' || p[1] == 0) {
+                const std::size_t n = 1 + std::strcspn(p + 1, "%");
+                text(p, n);
+                p += n;
+                continue;
+            }
+            op o = { field::text, false, { 0, 0 }, { 0, 0 }, attribute() };
+            switch (p[1]) {
+                case 't': o.kind = field::time; break;
+                case 'L': o.kind = field::levelName; break;
+                case 'T': o.kind = field::thread; break;
+                case 'n': o.kind = field::logger; break;
+                case 'm': o.kind = field::message; break;
+                default:
+                    // %% is a percent sign, unknown fields are kept as text
+                    text(p, p[1] == '%' ? 1 : 2);
+                    p += 2;
+                    continue;
+            }
+            p += 2;
+            if (*p == '{') {
+                const char *end = std::strchr(p, '}');
+                if (end && style(o, p + 1, end)) {
+                    p = end + 1;
+                }
+            }
+            ops.push_back(o);
+        }
+
+        // Room for the fields whose size does not depend on the event
+        fixedBound = 1;
+        for (const op &o : ops) {
+            fixedBound += o.byLevel ? maxLevelOpen + 4
+                                    : o.open.size != 0 ? o.open.size + 4 : 0;
+            switch (o.kind) {
+                case field::text: fixedBound += o.text.size; break;
+                case field::time: fixedBound += 23; break;
+                case field::levelName: fixedBound += maxLevelName; break;
+                case field::thread: fixedBound += 20; break;
+                case field::logger: ++loggerFields; break;
+                case field::message: ++messageFields; break;
+            }
+        }
+    }
+
+    // Parse the names between { and }, false if any is unknown
+    bool style(op &o, const char *p, const char *end)
+    {
+        if (end - p == 5 && std::strncmp(p, "level", 5) == 0) {
+            o.byLevel = true;
+            return true;
+        }
+        attribute attr;
+        bool any = false;
+        while (p != end) {
+            if (*p == ' ') {
+                ++p;
+                continue;
+            }
+            const char *word = p;
+            while (p != end && *p != ' ') {
+                ++p;
+            }
+            if (!rang_implementation::applyName(
+                  attr, word, static_cast<std::size_t>(p - word))) {
+                return false;
+            }
+            any = true;
+        }
+        o.attr = attr;
+        o.open = addOpen(attr);
+        return any;
+    }
+
+    void text(const char *s, std::size_t n)
+    {
+        if (!ops.empty() && ops.back().kind == field::text
+            && ops.back().text.offset + ops.back().text.size == pool.size()) {
+            ops.back().text.size += static_cast<std::uint32_t>(n);
+            pool.append(s, n);
+            return;
+        }
+        ops.push_back(
+          { field::text, false, add(s, n), { 0, 0 }, attribute() });
+    }
+
+    slice add(const char *s, std::size_t n)
+    {
+        const slice added = { static_cast<std::uint32_t>(pool.size()),
+                              static_cast<std::uint32_t>(n) };
+        pool.append(s, n);
+        return added;
+    }
+
+    slice addOpen(attribute const attr)
+    {
+        using rang_implementation::writeTransition;
+        char seq[rang_implementation::maxTransition];
+        return add(seq, writeTransition(attribute(), attr, seq));
+    }
+
+    // Write width digits of value ending at end
+    static void putDigits(char *end, std::uint64_t value, int width) noexcept
+    {
+        while (width-- != 0) {
+            *--end = static_cast<char>('0' + value % 10);
+            value /= 10;
+        }
+    }
+
+    static char *writeNumber(char *out, std::uint64_t value) noexcept
+    {
+        char digits[20];
+        char *p = digits + sizeof(digits);
+        do {
+            *--p = static_cast<char>('0' + value % 10);
+            value /= 10;
+        } while (value != 0);
+        return std::copy(p, digits + sizeof(digits), out);
+    }
+
+    static char *writeSigned(char *out, int value) noexcept
+    {
+        std::uint64_t magnitude = static_cast<std::uint64_t>(value);
+        if (value < 0) {
+            *out++    = '-';
+            magnitude = 0 - magnitude;
+        }
+        return writeNumber(out, magnitude);
+    }
+
+    static char *writeTime(char *out,
+                           std::chrono::system_clock::time_point const time)
+    {
+        using namespace std::chrono;
+        const std::int64_t ms
+          = duration_cast<milliseconds>(time.time_since_epoch()).count();
+        std::int64_t days = ms / 86400000;
+        std::int64_t rest = ms % 86400000;
+        if (rest < 0) {
+            rest += 86400000;
+            --days;
+        }
+        // Civil date from days since 1970-01-01
+        days += 719468;
+        const std::int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+        const std::int64_t doe = days - era * 146097;
+        const std::int64_t yoe
+          = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        const std::int64_t doy   = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        const std::int64_t mp    = (5 * doy + 2) / 153;
+        const std::int64_t day   = doy - (153 * mp + 2) / 5 + 1;
+        const std::int64_t month = mp < 10 ? mp + 3 : mp - 9;
+        const std::int64_t year  = yoe + era * 400 + (month <= 2);
+
+        char text[] = "0000-00-00 00:00:00.000";
+        putDigits(text + 4, static_cast<std::uint64_t>(year), 4);
+        putDigits(text + 7, static_cast<std::uint64_t>(month), 2);
+        putDigits(text + 10, static_cast<std::uint64_t>(day), 2);
+        putDigits(text + 13, static_cast<std::uint64_t>(rest / 3600000), 2);
+        putDigits(text + 16, static_cast<std::uint64_t>(rest / 60000 % 60), 2);
+        putDigits(text + 19, static_cast<std::uint64_t>(rest / 1000 % 60), 2);
+        putDigits(text + 23, static_cast<std::uint64_t>(rest % 1000), 3);
+        return std::copy(text, text + sizeof(text) - 1, out);
+    }
+
+    std::string pool;
+    std::vector<op> ops;
+    std::vector<levelEntry> levels;
+    std::size_t maxLevelName = 11;  // an unnamed level prints as a number
+    std::size_t maxLevelOpen = 0;
+    std::size_t fixedBound   = 0;
+    std::size_t loggerFields = 0, messageFields = 0;
+};
+
+}  // namespace rang
+
+#endif /* ifndef RANG_LAYOUT_DOT_HPP */
@@ -0,0 +1,325 @@
+#ifndef RANG_MARKUP_DOT_HPP
+#define RANG_MARKUP_DOT_HPP
+
+#include "rang.hpp"
+
+#include <mutex>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+namespace rang {
+
+namespace rang_implementation {
+
+    /* Apply one markup name to attr: a style name, a color, bright-<color>,
+     * on-<color> or on-bright-<color>. False for unknown names.
+     */
+    inline bool applyName(attribute &attr, const char *name,
+                          std::size_t n) noexcept
+    {
+        static const char *const styles[]
+          = { "reset",     "bold",     "dim",     "italic",
+              "underline", "blink",    "rblink",  "reversed",
+              "conceal",   "crossed" };
+        static const char *const colors[]
+          = { "black", "red", "green", "yellow",
+              "blue",  "magenta", "cyan", "gray" };
+
+        const auto match = [&](const char *prefix) {
+            const std::size_t len = std::strlen(prefix);
+            if (n < len || std::strncmp(name, prefix, len) != 0) {
+                return false;
+            }
+            name += len;
+            n -= len;
+            return true;
+        };
+        const auto equals = [&](const char *word) {
+            return std::strlen(word) == n && std::strncmp(name, word, n) == 0;
+        };
+
+        for (int i = 0; i < 10; ++i) {
+            if (equals(styles[i])) {
+                attr.apply(static_cast<style>(i));
+                return true;
+            }
+        }
+        const bool background = match("on-");
+        const bool bright     = match("bright-");
+        for (int i = 0; i < 8; ++i) {
+            if (!equals(colors[i])) {
+                continue;
+            }
+            if (background && bright) {
+                attr.apply(static_cast<bgB>(100 + i));
+            } else if (background) {
+                attr.apply(static_cast<bg>(40 + i));
+            } else if (bright) {
+                attr.apply(static_cast<fgB>(90 + i));
+            } else {
+                attr.apply(static_cast<fg>(30 + i));
+            }
+            return true;
+        }
+        return false;
+    }
+
+}  // namespace rang_implementation
+
+/* Inline markup compiled once into a program of text slices, precomputed
+ * SGR strings and argument slots:
+ *
+ *   [red bold]error[/] in [cyan]{}[/]
+ *
+ * A tag holds space separated names: style names, colors, bright-<color>,
+ * on-<color> and on-bright-<color>. Tags nest on top of the enclosing
+ * attribute and [/] returns to it. {} takes the next argument. [[, {{ and
+ * }} stand for the literal characters; tags with unknown names are kept as
+ * text. Output always ends in the default attribute.
+ */
+class markup {
+    struct argRef {
+        const void *value;
+        void (*write)(std::ostream &, const void *);
+    };
+
+public:
+    template <std::size_t N>
+    struct call {
+        const markup &program;
+        argRef args[N + 1];
+
+        void write(std::ostream &os) const { program.run(os, args, N); }
+
+        friend std::ostream &operator<<(std::ostream &os, const call &c)
+        {
+            c.write(os);
+            return os;
+        }
+    };
+
+    explicit markup(const char *format) { compile(format); }
+
+    /* Program for format, compiled on the first call with that pointer and
+     * shared afterwards. Keyed by address, not contents: meant for string
+     * literals and other formats that outlive the program and never change.
+     * Programs are kept for the life of the process.
+     */
+    static const markup &cached(const char *format)
+    {
+        // Per thread front so repeated lookups take no lock
+        thread_local std::unordered_map<const char *, const markup *> local;
+        const auto hit = local.find(format);
+        if (hit != local.end()) {
+            return *hit->second;
+        }
+        static std::mutex lock;
+        static std::unordered_map<const char *, markup> shared;
+        std::lock_guard<std::mutex> guard(lock);
+        const markup &program
+          = shared
+              .emplace(std::piecewise_construct, std::forward_as_tuple(format),
+                       std::forward_as_tuple(format))
+              .first->second;
+        local.emplace(format, &program);
+        return program;
+    }
+
+    // Bind arguments for insertion into a stream: os << program(a, b)
+    template <typename... Args>
+    call<sizeof...(Args)> operator()(const Args &... args) const
+    {
+        const call<sizeof...(Args)> bound = { *this, { ref(args)... } };
+        return bound;
+    }
+
+    template <typename... Args>
+    void print(std::ostream &os, const Args &... args) const
+    {
+        const argRef refs[sizeof...(Args) + 1] = { ref(args)... };
+        run(os, refs, sizeof...(Args));
+    }
+
+    std::size_t size() const noexcept { return ops.size(); }
+
+private:
+    enum class opKind : unsigned char { text, sgr, arg };
+
+    // text and sgr slice pool, arg holds the argument index in offset
+    struct op {
+        opKind kind;
+        std::uint32_t offset;
+        std::uint32_t size;
+        std::uint32_t attr;  // attribute::raw() in effect after sgr
+    };
+
+    template <typename T>
+    static argRef ref(const T &value) noexcept
+    {
+        return argRef{ &value, &writeArg<T> };
+    }
+
+    template <typename T>
+    static void writeArg(std::ostream &os, const void *value)
+    {
+        os << *static_cast<const T *>(value);
+    }
+
+    void run(std::ostream &os, const argRef *args, std::size_t count) const
+    {
+        std::streambuf *buf = os.rdbuf();
+        if (!buf) {
+            return;
+        }
+        const bool ansi  = rang_implementation::ansiEnabled(buf);
+        const char *data = pool.data();
+        for (const op &o : ops) {
+            switch (o.kind) {
+                case opKind::text: buf->sputn(data + o.offset, o.size); break;
+                case opKind::sgr:
+                    if (ansi) {
+                        buf->sputn(data + o.offset, o.size);
+                    } else {
+                        // Native console or colors off
+                        os << attribute::fromRaw(o.attr);
+                    }
+                    break;
+                case opKind::arg:
+                    if (o.offset < count) {
+                        args[o.offset].write(os, args[o.offset].value);
+                    } else {
+                        buf->sputn("{}", 2);
+                    }
+                    break;
+            }
+        }
+        if (ansi) {
+            rang_implementation::count(rang_implementation::textBytesCounter,
+                                       textBytes);
+            rang_implementation::count(
+              rang_implementation::escapeBytesCounter, escapeBytes);
+        }
+    }
+
+    void compile(const char *p)
+    {
+        std::vector<attribute> stack(1);
+        std::uint32_t args = 0;
+        while (*p != 0) {
+            const char c = *p;
+            if ((c == '[' || c == '{' || c == '}') && p[1] == c) {
+                text(p, 1, stack.back());
+                p += 2;
+            } else if (c == '{' && p[1] == '}') {
+                emit({ opKind::arg, args++, 0, 0 }, stack.back());
+                p += 2;
+            } else if (c == '[' && tag(p, stack)) {
+                p = std::strchr(p, ']') + 1;
+            } else {
+                // Plain text runs up to the next special character
+                std::size_t n = 1 + std::strcspn(p + 1, "[{}");
+                text(p, n, stack.back());
+                p += n;
+            }
+        }
+        sgr(attribute());
+    }
+
+    // Apply the tag starting at p, false if it is not a valid tag
+    static bool tag(const char *p, std::vector<attribute> &stack)
+    {
+        const char *end = std::strchr(p, ']');
+        if (!end) {
+            return false;
+        }
+        ++p;
+        if (end - p == 1 && *p == '/') {
+            if (stack.size() == 1) {
+                return false;
+            }
+            stack.pop_back();
+            return true;
+        }
+        attribute attr = stack.back();
+        bool any       = false;
+        while (p != end) {
+            if (*p == ' ') {
+                ++p;
+                continue;
+            }
+            const char *word = p;
+            while (p != end && *p != ' ') {
+                ++p;
+            }
+            if (!rang_implementation::applyName(
+                  attr, word, static_cast<std::size_t>(p - word))) {
+                return false;
+            }
+            any = true;
+        }
+        if (any) {
+            stack.push_back(attr);
+        }
+        return any;
+    }
+
+    // Attribute changes are only emitted once output depends on them
+    void emit(op const value, attribute const attr)
+    {
+        sgr(attr);
+        ops.push_back(value);
+    }
+
+    void text(const char *s, std::size_t n, attribute const attr)
+    {
+        sgr(attr);
+        if (!ops.empty() && ops.back().kind == opKind::text) {
+            ops.back().size += static_cast<std::uint32_t>(n);
+        } else {
+            ops.push_back(
+              { opKind::text, slice(), static_cast<std::uint32_t>(n), 0 });
+        }
+        pool.append(s, n);
+        textBytes += n;
+    }
+
+    void sgr(attribute const attr)
+    {
+        char seq[rang_implementation::maxTransition];
+        const std::size_t n
+          = rang_implementation::writeTransition(emitted, attr, seq);
+        if (n == 0) {
+            return;
+        }
+        ops.push_back({ opKind::sgr, slice(), static_cast<std::uint32_t>(n),
+                        attr.raw() });
+        pool.append(seq, n);
+        escapeBytes += n;
+        emitted = attr;
+    }
+
+    std::uint32_t slice() const noexcept
+    {
+        return static_cast<std::uint32_t>(pool.size());
+    }
+
+    std::string pool;
+    std::vector<op> ops;
+    attribute emitted;
+    std::size_t textBytes = 0, escapeBytes = 0;
+};
+
+}  // namespace rang
+
+/* Markup compiled once per call site on first use, for constant format
+ * strings: std::cout << RANG_MARKUP("[green]ok[/] {}")(name);
+ */
+#define RANG_MARKUP(format)                                                    \
+    ([]() -> const ::rang::markup & {                                          \
+        static const ::rang::markup program(format);                          \
+        return program;                                                        \
+    }())
+
+#endif /* ifndef RANG_MARKUP_DOT_HPP */
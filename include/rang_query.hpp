@@ -0,0 +1,375 @@
+#ifndef RANG_QUERY_DOT_HPP
+#define RANG_QUERY_DOT_HPP
+
+#include "rang.hpp"
+
+#include <chrono>
+#include <mutex>
+
+#if defined(__unix__) || defined(__unix) || defined(__linux__)                \
+  || defined(__APPLE__) || defined(__MACH__)
+#define RANG_QUERY_TTY
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace rang {
+
+// What the terminal reported about itself
+struct terminalInfo {
+    bool answered   = false;  // replied before the timeout
+    bool truecolor  = false;  // XTGETTCAP confirmed RGB or Tc
+    bool background = false;  // OSC 11 reported a background color
+    unsigned char red = 0, green = 0, blue = 0;
+
+    // Background darker than mid gray, false when it is unknown
+    bool dark() const noexcept
+    {
+        return background && 299 * red + 587 * green + 114 * blue < 127500;
+    }
+};
+
+namespace rang_implementation {
+
+    inline int hexDigit(char const c) noexcept
+    {
+        return c >= '0' && c <= '9' ? c - '0'
+          : c >= 'a' && c <= 'f'    ? c - 'a' + 10
+          : c >= 'A' && c <= 'F'    ? c - 'A' + 10
+                                    : -1;
+    }
+
+    // One "rgb:" component of 1 to 4 hex digits scaled to 8 bits
+    inline bool parseComponent(const char *&p, const char *end,
+                               unsigned char &value) noexcept
+    {
+        unsigned long n = 0, max = 0;
+        int digits      = 0;
+        for (; p != end && hexDigit(*p) >= 0 && digits < 4; ++p, ++digits) {
+            n   = n * 16 + static_cast<unsigned long>(hexDigit(*p));
+            max = max * 16 + 15;
+        }
+        if (digits == 0) {
+            return false;
+        }
+        value = static_cast<unsigned char>((n * 255 + max / 2) / max);
+        return true;
+    }
+
+    // "11;rgb:RRRR/GGGG/BBBB" reply to the OSC 11 query
+    inline void parseBackground(const char *p, const char *end,
+                                terminalInfo &info) noexcept
+    {
+        static const char prefix[] = "11;rgb:";
+        const std::size_t n        = sizeof prefix - 1;
+        if (static_cast<std::size_t>(end - p) < n
+            || std::memcmp(p, prefix, n) != 0) {
+            return;
+        }
+        p += n;
+        unsigned char rgb[3];
+        for (int i = 0; i < 3; ++i) {
+            if (i != 0 && (p == end || *p++ != '/')) {
+                return;
+            }
+            if (!parseComponent(p, end, rgb[i])) {
+                return;
+            }
+        }
+        info.background = true;
+        info.red        = rgb[0];
+        info.green      = rgb[1];
+        info.blue       = rgb[2];
+    }
+
+    // "1+r<name>[=value][;...]" reply to XTGETTCAP, 0+r when unknown
+    inline void parseCapability(const char *p, const char *end,
+                                terminalInfo &info) noexcept
+    {
+        if (end - p < 3 || std::memcmp(p, "1+r", 3) != 0) {
+            return;
+        }
+        for (p += 3; p < end;) {
+            const char *name = p;
+            while (p != end && *p != '=' && *p != ';') {
+                ++p;
+            }
+            const std::size_t n = static_cast<std::size_t>(p - name);
+            // "RGB" and "Tc" in hex
+            if ((n == 6 && std::strncmp(name, "524742", 6) == 0)
+                || (n == 4 && std::strncmp(name, "5463", 4) == 0)) {
+                info.truecolor = true;
+            }
+            while (p != end && *p != ';') {
+                ++p;
+            }
+            ++p;
+        }
+    }
+
+    /* Scan the replies read so far into info. True once the DA1 reply,
+     * which terminals send after answering the earlier queries, is in.
+     * Incomplete sequences at the end are left for the next scan.
+     */
+    inline bool parseReplies(const char *p, const char *end,
+                             terminalInfo &info) noexcept
+    {
+        while (p != end) {
+            p = static_cast<const char *>(
+              std::memchr(p, '\033', static_cast<std::size_t>(end - p)));
+            if (!p || end - p < 2) {
+                return false;
+            }
+            const char kind = p[1];
+            const char *body = p + 2;
+            if (kind == '[') {
+                // CSI: DA1 is ESC [ ? ... c
+                const char *q = body;
+                while (q != end && (*q < 0x40 || *q > 0x7e)) {
+                    ++q;
+                }
+                if (q == end) {
+                    return false;
+                }
+                if (*q == 'c' && q != body && *body == '?') {
+                    info.answered = true;
+                    return true;
+                }
+                p = q + 1;
+            } else if (kind == ']' || kind == 'P') {
+                // OSC or DCS, ended by BEL or ESC backslash
+                const char *q = body;
+                while (q != end && *q != '\a'
+                       && !(*q == '\033' && q + 1 != end && q[1] == '\\')) {
+                    ++q;
+                }
+                if (q == end || (*q == '\033' && q + 1 == end)) {
+                    return false;
+                }
+                if (kind == ']') {
+                    parseBackground(body, q, info);
+                } else {
+                    parseCapability(body, q, info);
+                }
+                info.answered = true;
+                p = q + (*q == '\a' ? 1 : 2);
+            } else {
+                p += 1;
+            }
+        }
+        return false;
+    }
+
+}  // namespace rang_implementation
+
+/* Asks a terminal for its background color (OSC 11) and truecolor support
+ * (XTGETTCAP RGB and Tc), followed by DA1, which every VT100 descendant
+ * answers and so marks the end of the replies. start() switches the tty
+ * to raw mode and sends the queries without waiting; finish() collects
+ * replies until the DA1 answer or the timeout and restores the tty.
+ * Only the foreground process group can query its controlling terminal.
+ * Anything typed in between is consumed, and when the replies do not all
+ * arrive in time finish() discards pending input so late ones cannot show
+ * up on stdin later. Always unanswered off Unix.
+ */
+class terminalQuery {
+public:
+    // Query the controlling terminal through /dev/tty
+    terminalQuery() noexcept
+    {
+#ifdef RANG_QUERY_TTY
+        fd    = ::open("/dev/tty", O_RDWR | O_NOCTTY | O_CLOEXEC);
+        owned = fd >= 0;
+#endif
+    }
+
+    // Query the terminal on fd, which stays open
+    explicit terminalQuery(int const fd) noexcept : fd(fd) {}
+
+    terminalQuery(const terminalQuery &) = delete;
+    terminalQuery &operator=(const terminalQuery &) = delete;
+
+    ~terminalQuery()
+    {
+        restore();
+#ifdef RANG_QUERY_TTY
+        if (owned) {
+            ::close(fd);
+        }
+#endif
+    }
+
+    /* Send the queries, false if fd is not a terminal or the process is
+     * not in its foreground group, where touching it would stop the
+     * process with SIGTTOU or SIGTTIN.
+     */
+    bool start() noexcept
+    {
+#ifdef RANG_QUERY_TTY
+        if (started || fd < 0 || !::isatty(fd)
+            || ::tcgetpgrp(fd) != ::getpgrp() || ::tcgetattr(fd, &saved)) {
+            return false;
+        }
+        termios raw = saved;
+        raw.c_lflag &= ~static_cast<tcflag_t>(ICANON | ECHO);
+        raw.c_cc[VMIN]  = 0;
+        raw.c_cc[VTIME] = 0;
+        if (::tcsetattr(fd, TCSANOW, &raw)) {
+            return false;
+        }
+        started = true;
+        static const char queries[] = "\033]11;?\033\\"
+                                      "\033P+q524742;5463\033\\"
+                                      "\033[c";
+        if (!send(queries, sizeof queries - 1)) {
+            restore();
+            return false;
+        }
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /* Wait at most timeout for the replies and restore the tty. Returns
+     * what was understood; answered stays false on a silent terminal.
+     */
+    terminalInfo finish(std::chrono::milliseconds const timeout
+                        = std::chrono::milliseconds(50)) noexcept
+    {
+        terminalInfo info;
+#ifdef RANG_QUERY_TTY
+        if (!started) {
+            return info;
+        }
+        using clock = std::chrono::steady_clock;
+        const clock::time_point deadline = clock::now() + timeout;
+        char replies[1024];
+        std::size_t size = 0;
+        bool complete    = false;
+        for (;;) {
+            if (rang_implementation::parseReplies(replies, replies + size,
+                                                  info)) {
+                complete = true;
+                break;
+            }
+            const auto left = std::chrono::duration_cast<
+              std::chrono::milliseconds>(deadline - clock::now());
+            if (left.count() < 0 || size == sizeof replies) {
+                break;
+            }
+            pollfd p = { fd, POLLIN, 0 };
+            const int ready = ::poll(&p, 1, static_cast<int>(left.count()));
+            if (ready < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ready <= 0) {
+                break;
+            }
+            const ssize_t n = ::read(fd, replies + size, sizeof replies - size);
+            if (n <= 0 && !(n < 0 && errno == EINTR)) {
+                break;
+            }
+            size += n > 0 ? static_cast<std::size_t>(n) : 0;
+        }
+        restore(!complete);
+#else
+        (void)timeout;
+#endif
+        return info;
+    }
+
+private:
+#ifdef RANG_QUERY_TTY
+    bool send(const char *data, std::size_t size) noexcept
+    {
+        while (size != 0) {
+            const ssize_t n = ::write(fd, data, size);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            data += n;
+            size -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+#endif
+
+    // Restore the tty, dropping unread input when replies may still come
+    void restore(bool const flush = true) noexcept
+    {
+#ifdef RANG_QUERY_TTY
+        if (started) {
+            ::tcsetattr(fd, flush ? TCSAFLUSH : TCSANOW, &saved);
+            started = false;
+        }
+#endif
+    }
+
+    int fd     = -1;
+    bool owned = false;
+#ifdef RANG_QUERY_TTY
+    bool started = false;
+    termios saved;
+#endif
+};
+
+namespace rang_implementation {
+
+    struct queryState {
+        std::mutex lock;
+        terminalQuery query;
+        bool started = false;
+        bool done    = false;
+        terminalInfo info;
+    };
+
+    inline queryState &terminalQueryState()
+    {
+        static queryState state;
+        return state;
+    }
+
+}  // namespace rang_implementation
+
+/* Send the controlling terminal's queries now and return at once, so the
+ * wait in terminalCapabilities() overlaps with other initialization.
+ */
+inline void startTerminalQuery()
+{
+    rang_implementation::queryState &state
+      = rang_implementation::terminalQueryState();
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (!state.started && !state.done) {
+        state.started = state.query.start();
+        state.done    = !state.started;
+    }
+}
+
+/* Replies of the controlling terminal, waiting at most timeout for them on
+ * the first call (starting the query if needed) and cached afterwards.
+ */
+inline terminalInfo terminalCapabilities(
+  std::chrono::milliseconds const timeout = std::chrono::milliseconds(50))
+{
+    startTerminalQuery();
+    rang_implementation::queryState &state
+      = rang_implementation::terminalQueryState();
+    std::lock_guard<std::mutex> guard(state.lock);
+    if (state.started) {
+        state.info    = state.query.finish(timeout);
+        state.started = false;
+        state.done    = true;
+    }
+    return state.info;
+}
+
+}  // namespace rang
+
+#endif /* ifndef RANG_QUERY_DOT_HPP */
@@ -0,0 +1,527 @@
+#ifndef RANG_RECORD_DOT_HPP
+#define RANG_RECORD_DOT_HPP
+
+#include "rang.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__unix) || defined(__linux__)                \
+  || defined(__APPLE__) || defined(__MACH__)
+#define RANG_RECORD_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace rang {
+
+/* Session log layout, all integers little endian:
+ *
+ *   "RANGREC1" u64 start          wall clock at start, microseconds
+ *   frames    varint dt, varint size, size bytes
+ *                                 dt: microseconds since the previous frame
+ *   index     (u64 time, u64 offset) per entry, u64 entries, "RANGIDX1"
+ *
+ * An index entry is added every recordIndexInterval bytes of frames and
+ * holds the time of the frame before offset, which is the base to decode
+ * from there. The index is written on close; logs cut short by a crash
+ * are still readable and get their index rebuilt by one scan.
+ */
+namespace rang_implementation {
+
+    constexpr char recordMagic[8] = { 'R', 'A', 'N', 'G', 'R', 'E', 'C', '1' };
+    constexpr char indexMagic[8]  = { 'R', 'A', 'N', 'G', 'I', 'D', 'X', '1' };
+    constexpr std::size_t recordHeader        = 16;
+    constexpr std::size_t recordIndexInterval = 64 * 1024;
+    constexpr std::size_t recordFlushSize     = 64 * 1024;
+    constexpr std::uint64_t recordFlushInterval = 1000000;
+
+    inline void putU64(std::string &out, std::uint64_t value)
+    {
+        for (int i = 0; i < 8; ++i) {
+            out += static_cast<char>(value >> (8 * i));
+        }
+    }
+
+    inline std::uint64_t getU64(const char *p) noexcept
+    {
+        std::uint64_t value = 0;
+        for (int i = 7; i >= 0; --i) {
+            value = (value << 8) | static_cast<unsigned char>(p[i]);
+        }
+        return value;
+    }
+
+    inline void putVarint(std::string &out, std::uint64_t value)
+    {
+        while (value >= 0x80) {
+            out += static_cast<char>((value & 0x7f) | 0x80);
+            value >>= 7;
+        }
+        out += static_cast<char>(value);
+    }
+
+    inline bool getVarint(const char *&p, const char *end,
+                          std::uint64_t &value) noexcept
+    {
+        value = 0;
+        for (int shift = 0; p != end && shift < 64; shift += 7) {
+            const unsigned char byte = static_cast<unsigned char>(*p++);
+            value |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    struct recordIndexEntry {
+        std::uint64_t time;
+        std::uint64_t offset;
+    };
+
+}  // namespace rang_implementation
+
+/* Tee streambuf that forwards everything to sink and records it, with a
+ * monotonic timestamp per flushed chunk, into an append-only session log.
+ * Writes only land in a put area; timestamping and logging happen when it
+ * is drained, and the log itself is written in large blocks.
+ *
+ * Flushing the stream flushes sink but not the log, which is written once
+ * recordFlushSize bytes or recordFlushInterval microseconds have piled
+ * up. A crash loses at most that much of the recording; the rest is
+ * recovered as a truncated log.
+ */
+class recordBuf : public std::streambuf {
+public:
+    recordBuf(std::streambuf *sink, const std::string &path)
+        : sink(sink), file(std::fopen(path.c_str(), "wb")),
+          start(std::chrono::steady_clock::now())
+    {
+        using namespace std::chrono;
+        log.append(rang_implementation::recordMagic, 8);
+        rang_implementation::putU64(
+          log, static_cast<std::uint64_t>(
+                 duration_cast<microseconds>(
+                   system_clock::now().time_since_epoch())
+                   .count()));
+        if (file) {
+            // The log is only written in whole blocks
+            std::setvbuf(file, nullptr, _IONBF, 0);
+        }
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    recordBuf(const recordBuf &) = delete;
+    recordBuf &operator=(const recordBuf &) = delete;
+
+    ~recordBuf() override
+    {
+        drain();
+        for (const auto &entry : index) {
+            rang_implementation::putU64(log, entry.time);
+            rang_implementation::putU64(log, entry.offset);
+        }
+        rang_implementation::putU64(log, index.size());
+        log.append(rang_implementation::indexMagic, 8);
+        writeLog();
+        if (file) {
+            std::fclose(file);
+        }
+        sink->pubsync();
+    }
+
+    bool good() const noexcept { return file != nullptr; }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        drain();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        if (n <= epptr() - pptr()) {
+            std::memcpy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+        } else {
+            drain();
+            frame(s, static_cast<std::size_t>(n));
+        }
+        return n;
+    }
+
+    int sync() override
+    {
+        drain();
+        return sink->pubsync();
+    }
+
+private:
+    void drain()
+    {
+        if (pptr() != pbase()) {
+            frame(pbase(), static_cast<std::size_t>(pptr() - pbase()));
+            setp(buffer, buffer + sizeof(buffer));
+        }
+    }
+
+    void frame(const char *s, std::size_t n)
+    {
+        using namespace std::chrono;
+        sink->sputn(s, static_cast<std::streamsize>(n));
+
+        const std::uint64_t now = static_cast<std::uint64_t>(
+          duration_cast<microseconds>(steady_clock::now() - start).count());
+        const std::uint64_t offset = written + log.size();
+        if (offset >= nextIndex) {
+            index.push_back({ last, offset });
+            nextIndex = offset + rang_implementation::recordIndexInterval;
+        }
+        rang_implementation::putVarint(log, now - last);
+        rang_implementation::putVarint(log, n);
+        log.append(s, n);
+        last = now;
+        if (log.size() >= rang_implementation::recordFlushSize
+            || now - logged >= rang_implementation::recordFlushInterval) {
+            writeLog();
+            logged = now;
+        }
+    }
+
+    void writeLog()
+    {
+        if (file && !log.empty()) {
+            std::fwrite(log.data(), 1, log.size(), file);
+        }
+        written += log.size();
+        log.clear();
+    }
+
+    std::streambuf *sink;
+    std::FILE *file;
+    const std::chrono::steady_clock::time_point start;
+    std::string log;  // not yet written part of the session log
+    std::uint64_t written   = 0;  // bytes of the log already in the file
+    std::uint64_t last      = 0;  // time of the previous frame
+    std::uint64_t logged    = 0;  // time the log was last written
+    std::uint64_t nextIndex = rang_implementation::recordHeader;
+    std::vector<rang_implementation::recordIndexEntry> index;
+    char buffer[4096];
+};
+
+/* Reader for session logs written by recordBuf. The log is memory mapped
+ * where possible; seek() uses the sparse index to start decoding at most
+ * recordIndexInterval bytes before the requested time.
+ */
+class replay {
+public:
+    struct frame {
+        std::uint64_t time;  // microseconds since the recording started
+        const char *data;
+        std::size_t size;
+    };
+
+    explicit replay(const std::string &path)
+    {
+        load(path);
+        if (size < rang_implementation::recordHeader
+            || std::memcmp(data, rang_implementation::recordMagic, 8) != 0) {
+            size = 0;
+            return;
+        }
+        startTime = rang_implementation::getU64(data + 8);
+        end       = size;
+        readIndex();
+        rewind();
+    }
+
+    replay(const replay &) = delete;
+    replay &operator=(const replay &) = delete;
+
+    ~replay()
+    {
+#ifdef RANG_RECORD_MMAP
+        if (mapped != 0) {
+            munmap(const_cast<char *>(data), mapped);
+        }
+#endif
+    }
+
+    bool good() const noexcept { return size != 0; }
+
+    // Wall clock time of the recording start, microseconds since epoch
+    std::uint64_t startedAt() const noexcept { return startTime; }
+
+    void rewind() noexcept
+    {
+        pos   = rang_implementation::recordHeader;
+        clock = 0;
+    }
+
+    bool next(frame &f) noexcept
+    {
+        const char *p    = data + pos;
+        const char *stop = data + end;
+        std::uint64_t dt, n;
+        if (!rang_implementation::getVarint(p, stop, dt)
+            || !rang_implementation::getVarint(p, stop, n)
+            || n > static_cast<std::uint64_t>(stop - p)) {
+            return false;
+        }
+        clock += dt;
+        f.time = clock;
+        f.data = p;
+        f.size = static_cast<std::size_t>(n);
+        pos    = static_cast<std::size_t>(p + n - data);
+        return true;
+    }
+
+    // Position so that next() returns the first frame at or after time
+    void seek(std::uint64_t time) noexcept
+    {
+        // Last entry strictly before time, frames ahead of it are earlier
+        auto it = std::lower_bound(
+          index.begin(), index.end(), time,
+          [](const rang_implementation::recordIndexEntry &e, std::uint64_t t) {
+              return e.time < t;
+          });
+        if (it == index.begin()) {
+            rewind();
+        } else {
+            --it;
+            pos   = static_cast<std::size_t>(it->offset);
+            clock = it->time;
+        }
+        frame f;
+        std::size_t before      = pos;
+        std::uint64_t beforeClk = clock;
+        while (next(f) && f.time < time) {
+            before    = pos;
+            beforeClk = clock;
+        }
+        pos   = before;
+        clock = beforeClk;
+    }
+
+    // Write frames from the current position to os in real time
+    void play(std::ostream &os, double speed = 1.0)
+    {
+        using namespace std::chrono;
+        frame f;
+        const auto wallStart         = steady_clock::now();
+        const std::uint64_t logStart = clock;
+        while (next(f)) {
+            const auto due = wallStart
+              + microseconds(static_cast<std::int64_t>(
+                static_cast<double>(f.time - logStart) / speed));
+            std::this_thread::sleep_until(due);
+            os.write(f.data, static_cast<std::streamsize>(f.size));
+            os.flush();
+        }
+    }
+
+private:
+    void load(const std::string &path)
+    {
+#ifdef RANG_RECORD_MMAP
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0) {
+            void *map = mmap(nullptr, static_cast<std::size_t>(st.st_size),
+                             PROT_READ, MAP_PRIVATE, fd, 0);
+            if (map != MAP_FAILED) {
+                data   = static_cast<const char *>(map);
+                size   = static_cast<std::size_t>(st.st_size);
+                mapped = size;
+            }
+        }
+        close(fd);
+#else
+        std::FILE *file = std::fopen(path.c_str(), "rb");
+        if (!file) {
+            return;
+        }
+        char chunk[1 << 16];
+        std::size_t got;
+        while ((got = std::fread(chunk, 1, sizeof(chunk), file)) != 0) {
+            copy.insert(copy.end(), chunk, chunk + got);
+        }
+        std::fclose(file);
+        data = copy.data();
+        size = copy.size();
+#endif
+    }
+
+    void readIndex()
+    {
+        using rang_implementation::getU64;
+        if (size >= rang_implementation::recordHeader + 16
+            && std::memcmp(data + size - 8, rang_implementation::indexMagic,
+                           8)
+              == 0) {
+            const std::uint64_t entries = getU64(data + size - 16);
+            const std::uint64_t bytes   = entries * 16 + 16;
+            if (bytes <= size - rang_implementation::recordHeader) {
+                end = size - static_cast<std::size_t>(bytes);
+                for (std::uint64_t i = 0; i < entries; ++i) {
+                    const char *p = data + end + i * 16;
+                    index.push_back({ getU64(p), getU64(p + 8) });
+                }
+                return;
+            }
+        }
+        // No index, the recording did not finish: rebuild it in one pass
+        rewind();
+        std::size_t nextEntry = pos;
+        std::uint64_t before  = 0;
+        frame f;
+        while (true) {
+            const std::size_t at = pos;
+            if (!next(f)) {
+                break;
+            }
+            if (at >= nextEntry) {
+                index.push_back({ before, at });
+                nextEntry = at + rang_implementation::recordIndexInterval;
+            }
+            before = f.time;
+        }
+        end = pos;
+    }
+
+    const char *data   = nullptr;
+    std::size_t size   = 0;
+    std::size_t end    = 0;  // end of the frames
+    std::size_t mapped = 0;  // length of the mapping, 0 if not mapped
+    std::vector<char> copy;
+    std::vector<rang_implementation::recordIndexEntry> index;
+    std::uint64_t startTime = 0;
+    std::size_t pos         = 0;
+    std::uint64_t clock     = 0;
+};
+
+namespace rang_implementation {
+
+    /* Append data to out as the contents of a JSON string. Bytes that do
+     * not form valid UTF-8 become U+FFFD, one per maximal invalid
+     * subsequence. An incomplete sequence at the end is left for more
+     * input unless final. Returns the number of bytes consumed.
+     */
+    inline std::size_t appendJsonText(std::string &out, const char *data,
+                                      std::size_t size, bool final)
+    {
+        std::size_t i = 0;
+        while (i < size) {
+            const unsigned char c = static_cast<unsigned char>(data[i]);
+            if (c < 0x80) {
+                if (c == '"' || c == '\\') {
+                    out += '\\';
+                    out += static_cast<char>(c);
+                } else if (c < 0x20 || c == 0x7f) {
+                    char escaped[8];
+                    std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    out += escaped;
+                } else {
+                    out += static_cast<char>(c);
+                }
+                ++i;
+                continue;
+            }
+            // Length and allowed second byte range, which rules out
+            // overlong forms, surrogates and values above U+10FFFF
+            std::size_t need = 0;
+            unsigned char lo = 0x80, hi = 0xbf;
+            if (c >= 0xc2 && c <= 0xdf) {
+                need = 2;
+            } else if (c >= 0xe0 && c <= 0xef) {
+                need = 3;
+                lo   = c == 0xe0 ? 0xa0 : 0x80;
+                hi   = c == 0xed ? 0x9f : 0xbf;
+            } else if (c >= 0xf0 && c <= 0xf4) {
+                need = 4;
+                lo   = c == 0xf0 ? 0x90 : 0x80;
+                hi   = c == 0xf4 ? 0x8f : 0xbf;
+            }
+            std::size_t valid = need == 0 ? 0 : 1;
+            while (valid != 0 && valid < need && i + valid < size) {
+                const unsigned char next
+                  = static_cast<unsigned char>(data[i + valid]);
+                if (next < lo || next > hi) {
+                    break;
+                }
+                lo = 0x80;
+                hi = 0xbf;
+                ++valid;
+            }
+            if (need != 0 && valid == need) {
+                out.append(data + i, need);
+                i += need;
+            } else if (i + valid == size && !final) {
+                break;
+            } else {
+                out += "\\ufffd";
+                i += valid == 0 ? 1 : valid;
+            }
+        }
+        return i;
+    }
+
+}  // namespace rang_implementation
+
+/* Export the frames from the current position of a replay as an asciicast
+ * v2 recording, for asciinema and compatible players. Output that is not
+ * valid UTF-8 is replaced with U+FFFD.
+ */
+inline void exportAsciicast(replay &session, std::ostream &os, int width,
+                            int height)
+{
+    os << "{\"version\": 2, \"width\": " << width << ", \"height\": " << height
+       << ", \"timestamp\": " << session.startedAt() / 1000000 << "}\n";
+
+    std::string pending;  // UTF-8 sequence split across frames
+    std::string event;
+    const auto emit = [&](std::uint64_t const time, bool const final) {
+        char stamp[32];
+        std::snprintf(stamp, sizeof(stamp), "%.6f",
+                      static_cast<double>(time) / 1e6);
+        event = "[";
+        event += stamp;
+        event += ", \"o\", \"";
+        pending.erase(0, rang_implementation::appendJsonText(
+                           event, pending.data(), pending.size(), final));
+        event += "\"]\n";
+        os.write(event.data(), static_cast<std::streamsize>(event.size()));
+    };
+
+    replay::frame f;
+    std::uint64_t last = 0;
+    while (session.next(f)) {
+        pending.append(f.data, f.size);
+        emit(f.time, false);
+        last = f.time;
+    }
+    // A sequence cut off by the end of the recording
+    if (!pending.empty()) {
+        emit(last, true);
+    }
+}
+
+}  // namespace rang
+
+#undef RANG_RECORD_MMAP
+
+#endif /* ifndef RANG_RECORD_DOT_HPP */
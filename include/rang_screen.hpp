@@ -0,0 +1,244 @@
+#ifndef RANG_SCREEN_DOT_HPP
+#define RANG_SCREEN_DOT_HPP
+
+#include "rang.hpp"
+
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace rang {
+
+/* Full-screen cell grid for dashboards and other repainting UIs. Drawing
+ * goes to a back buffer; present() compares it row by row with what the
+ * terminal shows (the front buffer) and emits only the changed spans, with
+ * short cursor moves and SGR deltas, in one write. Every cell is assumed
+ * to be one column wide.
+ */
+class screen {
+public:
+    struct cell {
+        char32_t codepoint;  // 0 is drawn as a space
+        std::uint32_t attr;  // attribute::raw()
+
+        bool operator==(const cell &other) const noexcept
+        {
+            return codepoint == other.codepoint && attr == other.attr;
+        }
+        bool operator!=(const cell &other) const noexcept
+        {
+            return !(*this == other);
+        }
+    };
+
+    screen(int width, int height) { resize(width, height); }
+
+    int width() const noexcept { return cols; }
+    int height() const noexcept { return rows; }
+
+    // Resizing clears the back buffer and repaints everything next frame
+    void resize(int width, int height)
+    {
+        cols = width > 0 ? width : 0;
+        rows = height > 0 ? height : 0;
+        back.assign(static_cast<std::size_t>(cols) * rows, blank());
+        front.assign(back.size(), blank());
+        invalidate();
+    }
+
+    void clear(attribute const attr = attribute())
+    {
+        std::fill(back.begin(), back.end(), cell{ 0, attr.raw() });
+    }
+
+    // Forget what the terminal shows, e.g. after other output went to it
+    void invalidate() noexcept { fullRepaint = true; }
+
+    cell &at(int x, int y) noexcept { return back[index(x, y)]; }
+    const cell &at(int x, int y) const noexcept { return back[index(x, y)]; }
+
+    void put(int x, int y, char32_t codepoint,
+             attribute const attr = attribute()) noexcept
+    {
+        if (x >= 0 && x < cols && y >= 0 && y < rows) {
+            back[index(x, y)] = cell{ codepoint, attr.raw() };
+        }
+    }
+
+    // Draw UTF-8 text clipped to the row, returns the column after it
+    int print(int x, int y, const char *utf8,
+              attribute const attr = attribute()) noexcept
+    {
+        const unsigned char *p = reinterpret_cast<const unsigned char *>(utf8);
+        while (*p != 0 && x < cols) {
+            put(x++, y, decode(p), attr);
+        }
+        return x;
+    }
+
+    /* Append the escapes and text turning the terminal's content into the
+     * back buffer to out, and take the back buffer as the new front.
+     */
+    void render(std::string &out)
+    {
+        using rang_implementation::writeTransition;
+        const std::size_t start = out.size();
+        std::size_t text        = 0;
+        char seq[rang_implementation::maxTransition];
+
+        attribute state;
+        curX = curY = -1;
+        if (fullRepaint) {
+            out += "\033[0m\033[H\033[2J";
+            curX = curY = 0;
+            std::fill(front.begin(), front.end(), blank());
+            fullRepaint = false;
+        }
+
+        for (int y = 0; y < rows; ++y) {
+            cell *b = &back[index(0, y)];
+            cell *f = &front[index(0, y)];
+            if (std::memcmp(b, f, sizeof(cell) * cols) == 0) {
+                continue;
+            }
+            int x = 0;
+            while (x < cols) {
+                while (x < cols && b[x] == f[x]) {
+                    ++x;
+                }
+                if (x == cols) {
+                    break;
+                }
+                // Extend the span over short unchanged gaps, rewriting a
+                // few cells is cheaper than another cursor move
+                int end = x + 1, gap = 0;
+                for (int i = end; i < cols && gap <= maxGap; ++i) {
+                    if (b[i] != f[i]) {
+                        end = i + 1;
+                        gap = 0;
+                    } else {
+                        ++gap;
+                    }
+                }
+                moveTo(out, x, y);
+                for (; x < end; ++x) {
+                    const attribute attr = attribute::fromRaw(b[x].attr);
+                    out.append(seq, writeTransition(state, attr, seq));
+                    state = attr;
+                    text += encode(out, b[x].codepoint);
+                }
+                // Past the last column the cursor position is unreliable
+                curX = x < cols ? x : -1;
+            }
+            std::copy(b, b + cols, f);
+        }
+        out.append(seq, writeTransition(state, attribute(), seq));
+
+        rang_implementation::count(rang_implementation::textBytesCounter,
+                                   text);
+        rang_implementation::count(rang_implementation::escapeBytesCounter,
+                                   out.size() - start - text);
+    }
+
+    /* Write the next frame to os in a single write. Streams which should
+     * not receive escapes get the whole back buffer as plain lines.
+     */
+    void present(std::ostream &os)
+    {
+        frame.clear();
+        if (rang_implementation::ansiEnabled(os.rdbuf())) {
+            render(frame);
+        } else {
+            for (int y = 0; y < rows; ++y) {
+                for (int x = 0; x < cols; ++x) {
+                    encode(frame, back[index(x, y)].codepoint);
+                }
+                frame += '\n';
+            }
+        }
+        os.write(frame.data(), static_cast<std::streamsize>(frame.size()));
+        os.flush();
+    }
+
+private:
+    static constexpr int maxGap = 4;
+
+    static cell blank() noexcept { return cell{ 0, 0 }; }
+
+    std::size_t index(int x, int y) const noexcept
+    {
+        return static_cast<std::size_t>(y) * cols + x;
+    }
+
+    void moveTo(std::string &out, int x, int y)
+    {
+        if (curY == y && curX == x) {
+            return;
+        }
+        char buf[32];
+        int n;
+        if (curY == y && curX >= 0 && x > curX) {
+            n = std::snprintf(buf, sizeof(buf), "\033[%dC", x - curX);
+        } else if (x == 0 && curY >= 0 && y == curY + 1 && curX >= 0) {
+            n = std::snprintf(buf, sizeof(buf), "\r\n");
+        } else {
+            n = std::snprintf(buf, sizeof(buf), "\033[%d;%dH", y + 1, x + 1);
+        }
+        out.append(buf, static_cast<std::size_t>(n));
+        curX = x;
+        curY = y;
+    }
+
+    static char32_t decode(const unsigned char *&p) noexcept
+    {
+        const unsigned char lead = *p++;
+        int extra
+          = lead >= 0xF0 ? 3 : lead >= 0xE0 ? 2 : lead >= 0xC0 ? 1 : 0;
+        char32_t cp = extra == 0 ? lead : lead & (0x3F >> extra);
+        for (; extra > 0 && (*p & 0xC0) == 0x80; --extra) {
+            cp = (cp << 6) | (*p++ & 0x3F);
+        }
+        return extra == 0 ? cp : 0xFFFD;
+    }
+
+    static std::size_t encode(std::string &out, char32_t cp)
+    {
+        if (cp == 0) {
+            cp = ' ';
+        }
+        char buf[4];
+        std::size_t n;
+        if (cp < 0x80) {
+            buf[0] = static_cast<char>(cp);
+            n      = 1;
+        } else if (cp < 0x800) {
+            buf[0] = static_cast<char>(0xC0 | (cp >> 6));
+            buf[1] = static_cast<char>(0x80 | (cp & 0x3F));
+            n      = 2;
+        } else if (cp < 0x10000) {
+            buf[0] = static_cast<char>(0xE0 | (cp >> 12));
+            buf[1] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            buf[2] = static_cast<char>(0x80 | (cp & 0x3F));
+            n      = 3;
+        } else {
+            buf[0] = static_cast<char>(0xF0 | (cp >> 18));
+            buf[1] = static_cast<char>(0x80 | ((cp >> 12) & 0x3F));
+            buf[2] = static_cast<char>(0x80 | ((cp >> 6) & 0x3F));
+            buf[3] = static_cast<char>(0x80 | (cp & 0x3F));
+            n      = 4;
+        }
+        out.append(buf, n);
+        return n;
+    }
+
+    int cols = 0, rows = 0;
+    int curX = -1, curY = -1;  // terminal cursor, -1 when unknown
+    bool fullRepaint = true;
+    std::vector<cell> back;
+    std::vector<cell> front;
+    std::string frame;
+};
+
+}  // namespace rang
+
+#endif /* ifndef RANG_SCREEN_DOT_HPP */
@@ -0,0 +1,257 @@
+#ifndef RANG_STYLED_TEXT_DOT_HPP
+#define RANG_STYLED_TEXT_DOT_HPP
+
+#include "rang.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace rang {
+
+/* Text built once and rendered to any number of sinks. The UTF-8 bytes are
+ * stored contiguously; attributes are kept apart as (offset, attribute)
+ * runs, each in effect up to the next one. Short texts with a couple of
+ * runs live entirely inside the object.
+ */
+class styledText {
+public:
+    struct run {
+        std::uint32_t offset;
+        std::uint32_t attr;  // attribute::raw()
+    };
+
+    styledText() = default;
+    styledText(const char *text) : bytes(text) {}
+    styledText(std::string text) : bytes(std::move(text)) {}
+
+    styledText(const styledText &other) : bytes(other.bytes)
+    {
+        reserveRuns(other.runCount);
+        std::copy(other.runData(), other.runData() + other.runCount,
+                  runData());
+        runCount = other.runCount;
+    }
+
+    styledText(styledText &&other) noexcept
+        : bytes(std::move(other.bytes)), storage(other.storage),
+          runCount(other.runCount), runCapacity(other.runCapacity)
+    {
+        other.runCount    = 0;
+        other.runCapacity = 0;
+    }
+
+    styledText &operator=(styledText other) noexcept
+    {
+        swap(other);
+        return *this;
+    }
+
+    ~styledText()
+    {
+        if (runCapacity != 0) {
+            delete[] storage.heap;
+        }
+    }
+
+    void swap(styledText &other) noexcept
+    {
+        bytes.swap(other.bytes);
+        std::swap(storage, other.storage);
+        std::swap(runCount, other.runCount);
+        std::swap(runCapacity, other.runCapacity);
+    }
+
+    template <typename T>
+    typename std::enable_if<rang_implementation::isAttribute<T>::value,
+                            styledText &>::type
+    operator<<(T const value)
+    {
+        return set(current().apply(value));
+    }
+
+    styledText &operator<<(attribute const value) { return set(value); }
+    styledText &operator<<(const std::string &text)
+    {
+        return append(text.data(), text.size());
+    }
+    styledText &operator<<(const char *text)
+    {
+        return append(text, std::strlen(text));
+    }
+    styledText &operator<<(char c) { return append(&c, 1); }
+
+    styledText &append(const char *text, std::size_t size)
+    {
+        bytes.append(text, size);
+        return *this;
+    }
+
+    // other starts from the default attribute, as it would on its own
+    styledText &operator+=(const styledText &other)
+    {
+        if (&other == this) {
+            // Appending grows the storage other is read from
+            const styledText copy(other);
+            return *this += copy;
+        }
+        const std::uint32_t base = static_cast<std::uint32_t>(bytes.size());
+        const attribute end      = current();
+        bytes += other.bytes;
+        if (other.runCount == 0 || other.runData()[0].offset != 0) {
+            setAt(base, attribute());
+        }
+        const run *r = other.runData();
+        for (std::uint32_t i = 0; i < other.runCount; ++i) {
+            setAt(base + r[i].offset, attribute::fromRaw(r[i].attr));
+        }
+        if (base == bytes.size()) {
+            setAt(base, end);
+        }
+        return *this;
+    }
+
+    friend styledText operator+(styledText lhs, const styledText &rhs)
+    {
+        return lhs += rhs;
+    }
+
+    // Attribute applied to text appended next
+    attribute current() const noexcept
+    {
+        return runCount == 0 ? attribute()
+                             : attribute::fromRaw(runData()[runCount - 1].attr);
+    }
+
+    const std::string &str() const noexcept { return bytes; }
+    std::size_t size() const noexcept { return bytes.size(); }
+    bool empty() const noexcept { return bytes.empty(); }
+
+    const run *runs() const noexcept { return runData(); }
+    std::size_t runsSize() const noexcept { return runCount; }
+
+    /* Single pass over the text: sink(attr, data, size) is called for every
+     * non-empty stretch of bytes sharing one attribute.
+     */
+    template <typename Sink>
+    void render(Sink &&sink) const
+    {
+        const run *r    = runData();
+        std::size_t pos = 0;
+        attribute attr;
+        for (std::uint32_t i = 0; i <= runCount; ++i) {
+            const std::size_t end = i < runCount ? r[i].offset : bytes.size();
+            if (end > pos) {
+                sink(attr, bytes.data() + pos, end - pos);
+                pos = end;
+            }
+            if (i < runCount) {
+                attr = attribute::fromRaw(r[i].attr);
+            }
+        }
+    }
+
+    // Append the text with minimal SGR transitions, ending in default state
+    void renderAnsi(std::string &out) const
+    {
+        using rang_implementation::writeTransition;
+        char seq[rang_implementation::maxTransition];
+        attribute state;
+        const std::size_t start = out.size();
+        out.reserve(start + bytes.size() + runCount * 8 + 4);
+        render([&](attribute attr, const char *data, std::size_t size) {
+            out.append(seq, writeTransition(state, attr, seq));
+            out.append(data, size);
+            state = attr;
+        });
+        out.append(seq, writeTransition(state, attribute(), seq));
+
+        rang_implementation::count(rang_implementation::textBytesCounter,
+                                   bytes.size());
+        rang_implementation::count(rang_implementation::escapeBytesCounter,
+                                   out.size() - start - bytes.size());
+    }
+
+private:
+    static constexpr std::uint32_t inlineRuns = 2;
+
+    styledText &set(attribute const value)
+    {
+        setAt(static_cast<std::uint32_t>(bytes.size()), value);
+        return *this;
+    }
+
+    void setAt(std::uint32_t offset, attribute const value)
+    {
+        if (runCount != 0 && runData()[runCount - 1].offset == offset) {
+            // Nothing was written under the last attribute yet
+            --runCount;
+        }
+        if (current() != value) {
+            reserveRuns(runCount + 1);
+            runData()[runCount++] = { offset, value.raw() };
+        }
+    }
+
+    // Room for count runs, moving them to the heap past inlineRuns
+    void reserveRuns(std::uint32_t const count)
+    {
+        const std::uint32_t capacity = runCapacity ? runCapacity : inlineRuns;
+        if (count <= capacity) {
+            return;
+        }
+        const std::uint32_t grown = std::max(count, capacity * 2);
+        run *heap                 = new run[grown];
+        std::copy(runData(), runData() + runCount, heap);
+        if (runCapacity != 0) {
+            delete[] storage.heap;
+        }
+        storage.heap = heap;
+        runCapacity  = grown;
+    }
+
+    run *runData() noexcept
+    {
+        return runCapacity == 0 ? storage.local : storage.heap;
+    }
+    const run *runData() const noexcept
+    {
+        return runCapacity == 0 ? storage.local : storage.heap;
+    }
+
+    // Inline runs and the heap array share the same bytes
+    union runStorage {
+        run local[inlineRuns];
+        run *heap;
+    };
+
+    std::string bytes;
+    runStorage storage        = {};
+    std::uint32_t runCount    = 0;
+    std::uint32_t runCapacity = 0;  // 0 while the runs are inline
+};
+
+// Smaller than keeping an ANSI string and a plain copy
+static_assert(sizeof(styledText) <= 2 * sizeof(std::string),
+              "styledText grew past two strings");
+
+inline std::ostream &operator<<(std::ostream &os, const styledText &text)
+{
+    if (rang_implementation::ansiEnabled(os.rdbuf())) {
+        std::string out;
+        text.renderAnsi(out);
+        return os.write(out.data(), static_cast<std::streamsize>(out.size()));
+    }
+    if (text.runsSize() == 0) {
+        return os << text.str();
+    }
+    // Native console or colors off: let the insertion operators decide
+    text.render([&](attribute attr, const char *data, std::size_t size) {
+        os << attr;
+        os.write(data, static_cast<std::streamsize>(size));
+    });
+    return os << style::reset;
+}
+
+}  // namespace rang
+
+#endif /* ifndef RANG_STYLED_TEXT_DOT_HPP */
@@ -0,0 +1,316 @@
+#ifndef RANG_TRANSCODE_DOT_HPP
+#define RANG_TRANSCODE_DOT_HPP
+
+#include "rang.hpp"
+
+#include <string>
+
+namespace rang {
+
+namespace rang_implementation {
+
+    /* Nearest of the 16 colors behind rang's fg/fgB enums, as 0-7 for the
+     * normal and 8-15 for the bright ones, for every 256-color index.
+     * Colors are matched against the xterm default palette.
+     */
+    struct paletteTable {
+        unsigned char nearest[256];
+
+        paletteTable() noexcept
+        {
+            for (int i = 0; i < 256; ++i) {
+                int r, g, b;
+                xterm256(i, r, g, b);
+                nearest[i] = i < 16 ? static_cast<unsigned char>(i)
+                                    : nearest16(r, g, b);
+            }
+        }
+
+        static void xterm256(int i, int &r, int &g, int &b) noexcept
+        {
+            static const unsigned char base[16][3]
+              = { { 0, 0, 0 },       { 205, 0, 0 },     { 0, 205, 0 },
+                  { 205, 205, 0 },   { 0, 0, 238 },     { 205, 0, 205 },
+                  { 0, 205, 205 },   { 229, 229, 229 }, { 127, 127, 127 },
+                  { 255, 0, 0 },     { 0, 255, 0 },     { 255, 255, 0 },
+                  { 92, 92, 255 },   { 255, 0, 255 },   { 0, 255, 255 },
+                  { 255, 255, 255 } };
+            if (i < 16) {
+                r = base[i][0];
+                g = base[i][1];
+                b = base[i][2];
+            } else if (i < 232) {
+                const int level[6] = { 0, 95, 135, 175, 215, 255 };
+                r = level[(i - 16) / 36];
+                g = level[(i - 16) / 6 % 6];
+                b = level[(i - 16) % 6];
+            } else {
+                r = g = b = 8 + (i - 232) * 10;
+            }
+        }
+
+        static unsigned char nearest16(int r, int g, int b) noexcept
+        {
+            unsigned char best = 0;
+            long bestDist      = -1;
+            for (int i = 0; i < 16; ++i) {
+                int pr, pg, pb;
+                xterm256(i, pr, pg, pb);
+                const long dist = (r - pr) * (r - pr) * 3L
+                  + (g - pg) * (g - pg) * 4L + (b - pb) * (b - pb) * 2L;
+                if (bestDist < 0 || dist < bestDist) {
+                    best     = static_cast<unsigned char>(i);
+                    bestDist = dist;
+                }
+            }
+            return best;
+        }
+    };
+
+    inline const paletteTable &palette() noexcept
+    {
+        static const paletteTable table;
+        return table;
+    }
+
+    // Truecolor goes through the 6x6x6 cube or the gray ramp first
+    inline int rgbTo256(int r, int g, int b) noexcept
+    {
+        const auto cube = [](int v) {
+            return v < 48 ? 0 : v < 115 ? 1 : (v - 35) / 40;
+        };
+        const int cr = cube(r), cg = cube(g), cb = cube(b);
+        if (cr == cg && cg == cb) {
+            const int avg = (r + g + b) / 3;
+            if (avg > 238) {
+                return 231;
+            }
+            if (avg >= 8) {
+                return 232 + (avg - 8) / 10;
+            }
+            return 16;
+        }
+        return 16 + 36 * cr + 6 * cg + cb;
+    }
+
+    // SGR parameter selecting color index 0-15 as foreground or background
+    inline int basicCode(int index, bool background) noexcept
+    {
+        const int normal = background ? static_cast<int>(rang::bg::black)
+                                      : static_cast<int>(rang::fg::black);
+        const int bright = background ? static_cast<int>(rang::bgB::black)
+                                      : static_cast<int>(rang::fgB::black);
+        return index < 8 ? normal + index : bright + index - 8;
+    }
+
+}  // namespace rang_implementation
+
+/* Streaming filter that rewrites 256-color and truecolor SGR parameters
+ * (38;5;n, 38;2;r;g;b and their 48 background forms) into the nearest of
+ * the 16 basic colors. Everything else, including other escape sequences,
+ * passes through unchanged. Memory use is constant: an escape sequence is
+ * only buffered up to a small limit and passed through untouched beyond.
+ */
+class transcodeBuf : public std::streambuf {
+public:
+    explicit transcodeBuf(std::streambuf *sink) : sink(sink)
+    {
+        rang_implementation::palette();
+        setp(buffer, buffer + sizeof(buffer));
+    }
+
+    transcodeBuf(const transcodeBuf &) = delete;
+    transcodeBuf &operator=(const transcodeBuf &) = delete;
+
+    ~transcodeBuf() override
+    {
+        drain();
+        flushSequence();
+        sink->pubsync();
+    }
+
+protected:
+    int_type overflow(int_type ch) override
+    {
+        drain();
+        if (!traits_type::eq_int_type(ch, traits_type::eof())) {
+            *pptr() = traits_type::to_char_type(ch);
+            pbump(1);
+        }
+        return traits_type::not_eof(ch);
+    }
+
+    std::streamsize xsputn(const char *s, std::streamsize n) override
+    {
+        if (n <= epptr() - pptr()) {
+            std::memcpy(pptr(), s, static_cast<std::size_t>(n));
+            pbump(static_cast<int>(n));
+        } else {
+            drain();
+            feed(s, s + n);
+        }
+        return n;
+    }
+
+    int sync() override
+    {
+        drain();
+        return sink->pubsync();
+    }
+
+private:
+    enum class parse { text, escape, csi };
+
+    static constexpr std::size_t maxSequence = 64;
+
+    void drain()
+    {
+        if (pptr() != pbase()) {
+            feed(pbase(), pptr());
+            setp(buffer, buffer + sizeof(buffer));
+        }
+    }
+
+    void feed(const char *p, const char *end)
+    {
+        while (p != end) {
+            if (state == parse::text) {
+                // Plain text is forwarded in bulk up to the next ESC
+                const char *esc = static_cast<const char *>(
+                  std::memchr(p, '\033', static_cast<std::size_t>(end - p)));
+                const char *stop = esc ? esc : end;
+                if (stop != p) {
+                    sink->sputn(p, stop - p);
+                }
+                if (!esc) {
+                    return;
+                }
+                seqLen = 0;
+                append(*esc);
+                state = parse::escape;
+                p     = esc + 1;
+                continue;
+            }
+            const char c = *p++;
+            append(c);
+            if (state == parse::escape) {
+                if (c == '[') {
+                    state = parse::csi;
+                } else {
+                    flushSequence();
+                }
+            } else if (c >= 0x40 && c <= 0x7e) {
+                // Final byte of the control sequence
+                if (c == 'm' && seqLen <= maxSequence) {
+                    rewrite();
+                } else {
+                    flushSequence();
+                }
+            } else if (seqLen >= maxSequence) {
+                flushSequence();
+            }
+        }
+    }
+
+    void append(char c) noexcept
+    {
+        if (seqLen < maxSequence) {
+            sequence[seqLen] = c;
+        }
+        ++seqLen;
+    }
+
+    // Pass a sequence through as received
+    void flushSequence()
+    {
+        if (seqLen != 0 && seqLen <= maxSequence) {
+            sink->sputn(sequence, static_cast<std::streamsize>(seqLen));
+        }
+        seqLen = 0;
+        state  = parse::text;
+    }
+
+    void rewrite()
+    {
+        using namespace rang_implementation;
+        // Parameters between "\033[" and "m", empty ones read as 0
+        int params[maxSequence];
+        std::size_t count = 0;
+        int value         = 0;
+        for (std::size_t i = 2; i + 1 < seqLen; ++i) {
+            const char c = sequence[i];
+            if (c >= '0' && c <= '9') {
+                value = value * 10 + (c - '0');
+                if (value > 0xffff) {
+                    value = 0xffff;
+                }
+            } else if (c == ';') {
+                params[count++] = value;
+                value           = 0;
+            } else {
+                // Private or colon separated forms are left alone
+                flushSequence();
+                return;
+            }
+        }
+        params[count++] = value;
+
+        char out[maxSequence * 4];
+        char *w     = out;
+        *w++        = '\033';
+        *w++        = '[';
+        bool change = false;
+        for (std::size_t i = 0; i < count; ++i) {
+            const int p = params[i];
+            if ((p == 38 || p == 48) && i + 2 < count && params[i + 1] == 5) {
+                const int index = params[i + 2] & 0xff;
+                w = writeParam(w, basicCode(palette().nearest[index], p == 48));
+                i += 2;
+                change = true;
+            } else if ((p == 38 || p == 48) && i + 4 < count
+                       && params[i + 1] == 2) {
+                const int index = rgbTo256(std::min(params[i + 2], 255),
+                                           std::min(params[i + 3], 255),
+                                           std::min(params[i + 4], 255));
+                w = writeParam(w, basicCode(palette().nearest[index], p == 48));
+                i += 4;
+                change = true;
+            } else {
+                w = writeParam(w, p);
+            }
+        }
+        if (!change) {
+            flushSequence();
+            return;
+        }
+        w[-1] = 'm';
+        sink->sputn(out, w - out);
+        seqLen = 0;
+        state  = parse::text;
+    }
+
+    static char *writeParam(char *out, int code) noexcept
+    {
+        char digits[8];
+        int n = 0;
+        do {
+            digits[n++] = static_cast<char>('0' + code % 10);
+            code /= 10;
+        } while (code != 0);
+        while (n != 0) {
+            *out++ = digits[--n];
+        }
+        *out++ = ';';
+        return out;
+    }
+
+    std::streambuf *sink;
+    char buffer[4096];
+    parse state = parse::text;
+    char sequence[maxSequence];
+    std::size_t seqLen = 0;
+};
+
+}  // namespace rang
+
+#endif /* ifndef RANG_TRANSCODE_DOT_HPP */
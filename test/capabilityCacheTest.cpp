@@ -0,0 +1,68 @@
+// Cases for the RANG_CAPABILITY_CACHE build, kept apart so test.cpp covers
+// the default configuration. Detection results are computed once per
+// process, so the case reading them through the cache comes first.
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#define RANG_CAPABILITY_CACHE
+#include "rang.hpp"
+#include <cstdio>
+#include <fstream>
+#include <string>
+
+using namespace std;
+using namespace rang;
+
+#if defined(__unix__) || defined(__unix) || defined(__linux__)                \
+  || defined(__APPLE__) || defined(__MACH__)
+TEST_CASE("Cache hit decides color support and terminals")
+{
+    using namespace rang_implementation;
+    const string fileName = "capabilities-hit.cache";
+
+    // The opposite of what detection finds, so only the cache can explain
+    // the answers
+    const bool color    = !detectColorSupport();
+    const bool coutTerm = isatty(fileno(stdout)) == 0;
+    const bool cerrTerm = isatty(fileno(stderr)) == 0;
+    REQUIRE(storeCapabilities(fileName.c_str(), capabilityKey(),
+                              (color ? colorFlag : 0)
+                                | (coutTerm ? coutTermFlag : 0)
+                                | (cerrTerm ? cerrTermFlag : 0)));
+
+    setCapabilityCache(fileName.c_str());
+    REQUIRE(supportsColor() == color);
+    REQUIRE(isTerminal(cout.rdbuf()) == coutTerm);
+    REQUIRE(isTerminal(cerr.rdbuf()) == cerrTerm);
+
+    remove(fileName.c_str());
+}
+
+TEST_CASE("Capability cache round trip")
+{
+    using namespace rang_implementation;
+    const string fileName = "capabilities.cache";
+    remove(fileName.c_str());
+
+    uint32_t flags = 0;
+    REQUIRE_FALSE(loadCapabilities(fileName.c_str(), 42, flags));
+
+    REQUIRE(storeCapabilities(fileName.c_str(), 42, colorFlag | cerrTermFlag));
+    REQUIRE(loadCapabilities(fileName.c_str(), 42, flags));
+    REQUIRE(flags == (colorFlag | cerrTermFlag));
+
+    SUBCASE("Different environment is a miss")
+    {
+        REQUIRE_FALSE(loadCapabilities(fileName.c_str(), 43, flags));
+    }
+
+    SUBCASE("Truncated file is rejected")
+    {
+        ofstream(fileName, ios::binary | ios::trunc) << "rang";
+        REQUIRE_FALSE(loadCapabilities(fileName.c_str(), 42, flags));
+    }
+
+    remove(fileName.c_str());
+}
+#endif
@@ -0,0 +1,169 @@
+// Insertion throughput from 1 to N threads, steady and with the control
+// mode re-applied or flipped concurrently, plus a consistency check of what
+// the threads wrote. Build with -DRANG_TSAN=ON to run it under
+// ThreadSanitizer.
+//
+//   concurrencyStress [max threads] [milliseconds per run]
+
+#include "rang.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+using namespace rang;
+
+namespace {
+
+// Keeps what was written so it can be checked, one per thread
+class checkBuf : public streambuf {
+public:
+    string data;
+
+protected:
+    streamsize xsputn(const char *s, streamsize n) override
+    {
+        if (data.size() < 1 << 20) {
+            data.append(s, static_cast<size_t>(n));
+        }
+        return n;
+    }
+
+    int_type overflow(int_type ch) override
+    {
+        return traits_type::not_eof(ch);
+    }
+};
+
+// Every insertion must have produced a whole sequence or nothing
+bool consistent(const string &data)
+{
+    static const char *const tokens[] = { "\033[31m", "\033[1m", "\033[0m",
+                                          "x" };
+    size_t i = 0;
+    while (i < data.size()) {
+        bool matched = false;
+        for (const char *token : tokens) {
+            const size_t n = char_traits<char>::length(token);
+            if (data.compare(i, n, token) == 0) {
+                i += n;
+                matched = true;
+                break;
+            }
+        }
+        if (!matched) {
+            return false;
+        }
+    }
+    return true;
+}
+
+enum class writer { none, reload, flip };
+
+struct result {
+    double perSecond;
+    bool consistent;
+};
+
+result measure(unsigned threads, writer mode, chrono::milliseconds length)
+{
+    setControlMode(control::Force);
+    atomic<bool> start(false), stop(false);
+    vector<unsigned long long> counts(threads * 8);  // 64 bytes apart
+    vector<checkBuf> buffers(threads);
+    vector<thread> pool;
+
+    for (unsigned t = 0; t < threads; ++t) {
+        pool.emplace_back([&, t] {
+            ostream os(&buffers[t]);
+            unsigned long long n = 0;
+            while (!start.load(memory_order_acquire)) {
+            }
+            while (!stop.load(memory_order_relaxed)) {
+                for (int i = 0; i < 64; ++i) {
+                    os << fg::red << style::bold << 'x' << style::reset;
+                }
+                n += 64;
+            }
+            counts[t * 8] = n;
+        });
+    }
+    thread config([&] {
+        while (!start.load(memory_order_acquire)) {
+        }
+        bool on = true;
+        while (!stop.load(memory_order_relaxed)) {
+            if (mode == writer::reload) {
+                // A configuration reload applying the same setting
+                setControlMode(control::Force);
+            } else if (mode == writer::flip) {
+                setControlMode(on ? control::Off : control::Force);
+                on = !on;
+            } else {
+                break;
+            }
+        }
+    });
+
+    const auto begin = chrono::steady_clock::now();
+    start.store(true, memory_order_release);
+    this_thread::sleep_for(length);
+    stop.store(true, memory_order_relaxed);
+    for (thread &t : pool) {
+        t.join();
+    }
+    config.join();
+    const double seconds
+      = chrono::duration<double>(chrono::steady_clock::now() - begin).count();
+
+    result r = { 0, true };
+    for (unsigned t = 0; t < threads; ++t) {
+        r.perSecond += counts[t * 8] / seconds;
+        r.consistent = r.consistent && consistent(buffers[t].data);
+    }
+    return r;
+}
+
+}  // namespace
+
+int main(int argc, char *argv[])
+{
+    unsigned maxThreads = thread::hardware_concurrency();
+    if (argc > 1) {
+        maxThreads = static_cast<unsigned>(atoi(argv[1]));
+    }
+    maxThreads = maxThreads == 0 ? 1 : maxThreads;
+    const chrono::milliseconds length(argc > 2 ? atoi(argv[2]) : 200);
+
+    static const char *const names[] = { "steady", "reload", "flip" };
+    bool ok = true;
+    for (int w = 0; w < 3; ++w) {
+        const writer mode = static_cast<writer>(w);
+        double single     = 0;
+        printf("%-6s threads  insertions/s  scaling\n", names[w]);
+        for (unsigned threads = 1;;) {
+            const result r = measure(threads, mode, length);
+            if (threads == 1) {
+                single = r.perSecond;
+            }
+            // Per-thread throughput relative to a single thread
+            printf("%14u  %12.0f  %6.2f%s\n", threads, r.perSecond,
+                   single > 0 ? r.perSecond / (single * threads) : 0.0,
+                   r.consistent ? "" : "  INCONSISTENT OUTPUT");
+            ok = ok && r.consistent;
+            if (threads >= maxThreads) {
+                break;
+            }
+            // Powers of two, ending on maxThreads itself
+            threads = min(threads * 2, maxThreads);
+        }
+    }
+    setControlMode(control::Auto);
+    return ok ? 0 : 1;
+}
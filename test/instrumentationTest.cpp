@@ -0,0 +1,65 @@
+// Cases for the RANG_INSTRUMENTATION build, kept apart so test.cpp covers
+// the default configuration
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#define RANG_INSTRUMENTATION
+#include "rang.hpp"
+#include "rang_layout.hpp"
+#include "rang_styled_text.hpp"
+#include <sstream>
+#include <string>
+
+using namespace std;
+using namespace rang;
+
+TEST_CASE("Instrumentation counts sequences and decisions")
+{
+    resetInstrumentation();
+    ostringstream out;
+
+    setControlMode(control::Force);
+    out << fg::red << "x" << style::reset << bgB::blue;
+    setControlMode(control::Off);
+    out << fg::red;
+    setControlMode(control::Auto);
+    out << fg::red;
+
+    styledText text;
+    text << fg::green << "ok";
+    string ansi;
+    text.renderAnsi(ansi);
+
+    const instrumentation counters = instrumentationSnapshot();
+    REQUIRE(counters.fg == 1);
+    REQUIRE(counters.style == 1);
+    REQUIRE(counters.bgB == 1);
+    REQUIRE(counters.force == 3);
+    REQUIRE(counters.off == 1);
+    REQUIRE(counters.noTerm + counters.notTty == 1);
+    REQUIRE(counters.textBytes == 2);
+    REQUIRE(counters.escapeBytes
+            == out.str().size() - 1 + ansi.size() - text.size());
+
+    resetInstrumentation();
+    REQUIRE(instrumentationSnapshot().fg == 0);
+}
+
+TEST_CASE("Styled output decides once per write")
+{
+    const layout lines("%L{level} [%n{cyan}] %m",
+                       { { 0, "INFO", attribute(fg::green) } });
+    const logEvent event(0, "app", "up");
+    for (const control mode : { control::Force, control::Off }) {
+        setControlMode(mode);
+        resetInstrumentation();
+        ostringstream out;
+        lines.write(out, event);
+        out << attribute(fg::red).apply(style::bold);
+        const instrumentation counters = instrumentationSnapshot();
+        REQUIRE(counters.force + counters.off == 2);
+        REQUIRE(counters.textBytes == 14);
+    }
+    setControlMode(control::Auto);
+}
@@ -0,0 +1,233 @@
+// Cases for the rang-cat tool, run against the binary at RANG_CAT_PATH
+
+#define DOCTEST_CONFIG_IMPLEMENT_WITH_MAIN
+#include "doctest.h"
+
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+
+#include <poll.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+struct result {
+    string output;
+    int status = -1;
+};
+
+// Run rang-cat with args through the shell, stderr merged into the output
+result run(const string &args, const string &before = "")
+{
+    const string command
+      = before + "\"" RANG_CAT_PATH "\" " + args + " 2>&1";
+    result r;
+    FILE *pipe = popen(command.c_str(), "r");
+    if (pipe == nullptr) {
+        return r;
+    }
+    char buffer[65536];
+    size_t got;
+    while ((got = fread(buffer, 1, sizeof buffer, pipe)) != 0) {
+        r.output.append(buffer, got);
+    }
+    const int status = pclose(pipe);
+    r.status         = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
+    return r;
+}
+
+struct tempFile {
+    explicit tempFile(const string &contents)
+    {
+        char name[] = "/tmp/rangCatTestXXXXXX";
+        const int fd = mkstemp(name);
+        CHECK(fd >= 0);
+        close(fd);
+        path = name;
+        ofstream(path, ios::binary) << contents;
+    }
+    ~tempFile() { remove(path.c_str()); }
+
+    string path;
+};
+
+// Input with the escape sequences removed
+string strip(const string &text)
+{
+    string plain;
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '\033') {
+            i = text.find('m', i);
+        } else {
+            plain += text[i];
+        }
+    }
+    return plain;
+}
+
+// Several chunks of lines of every kind rang-cat colors
+string bigLog()
+{
+    static const char *const levels[]
+      = { "INFO", "ERROR", "WARN", "DEBUG", "TRACE", "FATAL", "note" };
+    string log;
+    char line[128];
+    for (int i = 0; log.size() < 3u << 20; ++i) {
+        snprintf(line, sizeof line,
+                 "2024-01-31 12:00:%02d.%03d %s user=u%d took %dms\n", i % 60,
+                 i % 1000, levels[i % 7], i, i % 97);
+        log += line;
+    }
+    return log + "no newline at the end";
+}
+
+}  // namespace
+
+TEST_CASE("rang-cat colors levels, timestamps and keys")
+{
+    const tempFile input("2024-01-31T12:00:00Z ERROR user=bob INFO\n"
+                         "FATAL x\n"
+                         "WARNING y\n"
+                         "trace TRACE\n"
+                         "DEBUG");
+    const result r = run("--color=always -j 1 " + input.path);
+    REQUIRE(r.status == 0);
+    REQUIRE(r.output
+            == "\033[34m2024-01-31T12:00:00Z\033[39m \033[31mERROR\033[39m "
+               "\033[35muser\033[39m=bob INFO\n"
+               "\033[41mFATAL\033[49m x\n"
+               "\033[33mWARNING\033[39m y\n"
+               "trace \033[90mTRACE\033[39m\n"
+               "\033[36mDEBUG\033[39m");
+}
+
+TEST_CASE("rang-cat output does not depend on the thread count")
+{
+    const string log = bigLog();
+    const tempFile input(log);
+    const result one = run("--color=always -j 1 " + input.path);
+    REQUIRE(one.status == 0);
+    REQUIRE(strip(one.output) == log);
+
+    SUBCASE("Mapped file")
+    {
+        const result many = run("--color=always -j 4 " + input.path);
+        REQUIRE(many.status == 0);
+        REQUIRE(many.output == one.output);
+    }
+    SUBCASE("Pipe")
+    {
+        const result many
+          = run("--color=always -j 4", "cat \"" + input.path + "\" | ");
+        REQUIRE(many.status == 0);
+        REQUIRE(many.output == one.output);
+    }
+    SUBCASE("Several files in order")
+    {
+        const tempFile second("INFO second\n");
+        const result many = run("--color=always -j 3 " + second.path + " "
+                                + input.path + " " + second.path);
+        REQUIRE(many.status == 0);
+        const string again = "\033[32mINFO\033[39m second\n";
+        REQUIRE(many.output == again + one.output + again);
+    }
+    SUBCASE("No color copies the input")
+    {
+        const result plain = run("--color=never -j 4 " + input.path);
+        REQUIRE(plain.status == 0);
+        REQUIRE(plain.output == log);
+    }
+}
+
+TEST_CASE("rang-cat reports read errors and goes on")
+{
+    const tempFile input("INFO ok\n");
+    const string missing = input.path + ".missing";
+    const result r
+      = run("--color=never " + missing + " / " + input.path);
+    REQUIRE(r.status == 1);
+    REQUIRE(r.output.find("rang-cat: " + missing + ": " + strerror(ENOENT))
+            != string::npos);
+    REQUIRE(r.output.find(string("rang-cat: /: ") + strerror(EISDIR))
+            != string::npos);
+    REQUIRE(r.output.find("INFO ok\n") != string::npos);
+
+    const result colored = run("--color=always -j 2 /");
+    REQUIRE(colored.status == 1);
+    REQUIRE(colored.output == string("rang-cat: /: ") + strerror(EISDIR)
+              + "\n");
+}
+
+TEST_CASE("rang-cat rejects bad thread counts")
+{
+    for (const char *count : { "-j 0", "-j -1", "-j x", "-j 3x", "-j" }) {
+        CAPTURE(count);
+        const result r = run(string("--color=always ") + count, "true | ");
+        REQUIRE(r.status == 2);
+        REQUIRE(r.output.compare(0, 7, "usage: ") == 0);
+    }
+    const result many = run("--color=always -j 100000", "echo INFO | ");
+    REQUIRE(many.status == 0);
+    REQUIRE(many.output == "\033[32mINFO\033[39m\n");
+}
+
+TEST_CASE("rang-cat passes on piped lines before the input ends")
+{
+    int in[2], out[2];
+    REQUIRE(pipe(in) == 0);
+    REQUIRE(pipe(out) == 0);
+    const pid_t child = fork();
+    REQUIRE(child >= 0);
+    if (child == 0) {
+        dup2(in[0], 0);
+        dup2(out[1], 1);
+        close(in[0]);
+        close(in[1]);
+        close(out[0]);
+        close(out[1]);
+        execl(RANG_CAT_PATH, "rang-cat", "--color=always", "-j", "2",
+              static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    close(in[0]);
+    close(out[1]);
+
+    static const char line[] = "WARN first\nsecond without newline";
+    REQUIRE(write(in[1], line, sizeof line - 1)
+            == static_cast<ssize_t>(sizeof line - 1));
+    string output;
+    const string expected = "\033[33mWARN\033[39m first\n";
+    while (output.size() < expected.size()) {
+        pollfd p = { out[0], POLLIN, 0 };
+        if (poll(&p, 1, 5000) <= 0) {
+            break;
+        }
+        char buffer[256];
+        const ssize_t got = read(out[0], buffer, sizeof buffer);
+        if (got <= 0) {
+            break;
+        }
+        output.append(buffer, static_cast<size_t>(got));
+    }
+    CHECK(output == expected);
+
+    close(in[1]);
+    char buffer[256];
+    ssize_t got;
+    while ((got = read(out[0], buffer, sizeof buffer)) > 0) {
+        output.append(buffer, static_cast<size_t>(got));
+    }
+    close(out[0]);
+    int status = 0;
+    waitpid(child, &status, 0);
+    REQUIRE(WIFEXITED(status));
+    REQUIRE(WEXITSTATUS(status) == 0);
+    REQUIRE(output == expected + "second without newline");
+}
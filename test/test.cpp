@@ -2,8 +2,21 @@
 #include "doctest.h"
 
 #include "rang.hpp"
+#include "rang_diff.hpp"
+#include "rang_heat.hpp"
+#include "rang_highlight.hpp"
+#include "rang_layout.hpp"
+#include "rang_markup.hpp"
+#include "rang_query.hpp"
+#include "rang_record.hpp"
+#include "rang_screen.hpp"
+#include "rang_styled_text.hpp"
+#include "rang_transcode.hpp"
 #include <fstream>
+#include <iomanip>
+#include <sstream>
 #include <string>
+#include <vector>
 
 using namespace std;
 using namespace rang;
@@ -18,6 +31,11 @@ using namespace rang;
 #error Unknown Platform
 #endif
 
+#if defined(OS_LINUX) || defined(OS_MAC)
+#include <csignal>
+#include <sys/ioctl.h>
+#include <sys/wait.h>
+#endif
 
 TEST_CASE("Rang printing with control::Off and cout")
 {
@@ -348,3 +366,782 @@ TEST_CASE("Rang printing with control::Force and clog")
         REQUIRE(s.size() < output.size());
     }
 }
+
+TEST_CASE("Highlighter wraps matches in escapes")
+{
+    highlighter hl;
+    hl.add("error", fg::red).add("err", fg::yellow).add("req-42", style::bold);
+
+    SUBCASE("Leftmost longest match wins")
+    {
+        stringbuf sink;
+        {
+            highlightBuf buf(&sink, hl, true);
+            ostream out(&buf);
+            out << "an error in req-42, err";
+        }
+        REQUIRE(sink.str()
+                == "an \033[31merror\033[39m in \033[1mreq-42\033[22m, "
+                   "\033[33merr\033[39m");
+    }
+
+    SUBCASE("Matches may span writes")
+    {
+        stringbuf whole, split;
+        const string text = "xxerrorerrreq-4req-42req-";
+        {
+            highlightBuf buf(&whole, hl, true);
+            buf.sputn(text.data(), static_cast<streamsize>(text.size()));
+        }
+        {
+            highlightBuf buf(&split, hl, true);
+            for (const char c : text) {
+                buf.sputn(&c, 1);
+                buf.pubsync();
+            }
+        }
+        REQUIRE(whole.str() == split.str());
+        REQUIRE(whole.str().find("\033[31merror\033[39m") != string::npos);
+    }
+
+    SUBCASE("Plain passthrough without color")
+    {
+        stringbuf sink;
+        {
+            highlightBuf buf(&sink, hl, false);
+            ostream out(&buf);
+            out << "an error";
+        }
+        REQUIRE(sink.str() == "an error");
+    }
+
+    SUBCASE("Patterns using every byte value")
+    {
+        // 256 distinct bytes need 257 classes with the shared class 0
+        highlighter all;
+        string text, expected;
+        for (int c = 255; c >= 0; --c) {
+            const string p(1, static_cast<char>(c));
+            all.add(p + p, fg::red);
+            text += p + p + p;
+            expected += "\033[31m" + p + p + "\033[39m" + p;
+        }
+        // \0 and \xff would share a class in eight bits
+        all.add("AB\xff", fg::red);
+        const string mixed("AB\0", 3);
+        text += mixed;
+        expected += mixed;
+        stringbuf sink;
+        {
+            highlightBuf buf(&sink, all, true);
+            buf.sputn(text.data(), static_cast<streamsize>(text.size()));
+        }
+        REQUIRE(sink.str() == expected);
+    }
+
+    SUBCASE("Every start byte prefilter finds the same matches")
+    {
+        // One start byte, a few searched with memchr, and enough of them
+        // for two byte windows, each against a naive leftmost longest scan
+        const vector<vector<string>> sets
+          = { { "ab", "abc" }, { "ab", "ba", "c" }, { "ab", "bca", "cd", "d",
+                                                      "eab", "fe" } };
+        unsigned seed = 1;
+        const auto next = [&] { return (seed = seed * 1103515245 + 12345); };
+        for (const vector<string> &patterns : sets) {
+            highlighter set;
+            for (const string &p : patterns) {
+                set.add(p, fg::red);
+            }
+            for (int round = 0; round < 50; ++round) {
+                string text;
+                for (int i = 0; i < 300; ++i) {
+                    text += static_cast<char>('a' + (next() >> 16) % 7);
+                }
+                string expected;
+                for (size_t i = 0; i < text.size();) {
+                    size_t length = 0;
+                    for (const string &p : patterns) {
+                        if (text.compare(i, p.size(), p) == 0) {
+                            length = max(length, p.size());
+                        }
+                    }
+                    if (length == 0) {
+                        expected += text[i++];
+                    } else {
+                        expected += "\033[31m" + text.substr(i, length)
+                          + "\033[39m";
+                        i += length;
+                    }
+                }
+                stringbuf sink;
+                {
+                    highlightBuf buf(&sink, set, true);
+                    for (size_t i = 0; i < text.size(); i += 37) {
+                        buf.sputn(text.data() + i,
+                                  min<streamsize>(37, text.size() - i));
+                        buf.pubsync();
+                    }
+                }
+                REQUIRE(sink.str() == expected);
+            }
+        }
+    }
+}
+
+TEST_CASE("Attribute transitions are minimal")
+{
+    using rang_implementation::writeTransition;
+    char seq[rang_implementation::maxTransition];
+    const auto transition = [&](attribute from, attribute to) {
+        return string(seq, writeTransition(from, to, seq));
+    };
+
+    REQUIRE(transition(attribute(), attribute()) == "");
+    REQUIRE(transition(attribute(), fg::red) == "\033[31m");
+    REQUIRE(transition(fg::red, attribute(fg::red).apply(bgB::blue))
+            == "\033[104m");
+    REQUIRE(transition(attribute(style::bold).apply(fg::red), fg::red)
+            == "\033[0;31m");
+    REQUIRE(transition(fgB::gray, attribute()) == "\033[0m");
+    REQUIRE(attribute(fg::green).apply(fg::reset) == attribute());
+    REQUIRE(attribute(style::italic).apply(style::reset) == attribute());
+}
+
+TEST_CASE("Styled text stores runs apart from the text")
+{
+    styledText text;
+    text << "plain " << fg::red << style::bold << "error" << style::reset
+         << " done";
+
+    REQUIRE(text.str() == "plain error done");
+    REQUIRE(text.runsSize() == 2);
+
+    string ansi;
+    text.renderAnsi(ansi);
+    REQUIRE(ansi == "plain \033[1;31merror\033[0m done");
+
+    SUBCASE("Concatenation keeps each side's attributes")
+    {
+        styledText tail;
+        tail << fg::green << "ok";
+        const styledText joined = text + tail + styledText(" end");
+
+        string out;
+        joined.renderAnsi(out);
+        REQUIRE(out
+                == "plain \033[1;31merror\033[0m done\033[32mok\033[0m end");
+    }
+
+    SUBCASE("Custom render backends see one call per run")
+    {
+        int calls = 0;
+        string plain;
+        text.render([&](attribute, const char *data, size_t size) {
+            ++calls;
+            plain.append(data, size);
+        });
+        REQUIRE(calls == 3);
+        REQUIRE(plain == text.str());
+    }
+
+    SUBCASE("Many runs spill out of the inline storage")
+    {
+        styledText many;
+        for (int i = 0; i < 8; ++i) {
+            many << static_cast<fg>(30 + i) << "x";
+        }
+        REQUIRE(many.runsSize() == 8);
+        string out;
+        many.renderAnsi(out);
+        REQUIRE(out.find("\033[37mx\033[0m") != string::npos);
+    }
+
+    SUBCASE("Appending a text to itself")
+    {
+        styledText many;
+        for (int i = 0; i < 8; ++i) {
+            many << static_cast<fg>(30 + i) << "x";
+        }
+        styledText twice = many;
+        twice += styledText(many);
+        string expected;
+        twice.renderAnsi(expected);
+        many += many;
+        text += text;
+
+        string out;
+        text.renderAnsi(out);
+        REQUIRE(out == ansi + ansi);
+        out.clear();
+        many.renderAnsi(out);
+        REQUIRE(out == expected);
+    }
+}
+
+TEST_CASE("Screen emits only what changed between frames")
+{
+    screen scr(20, 4);
+    string out;
+    scr.render(out);
+    REQUIRE(out == "\033[0m\033[H\033[2J");
+
+    scr.print(2, 1, "load", fg::green);
+    scr.print(12, 1, "\xc3\xa9t\xc3\xa9");
+    out.clear();
+    scr.render(out);
+    REQUIRE(out == "\033[2;3H\033[32mload\033[6C\033[0m\xc3\xa9t\xc3\xa9");
+
+    SUBCASE("Unchanged frame is empty")
+    {
+        out.clear();
+        scr.render(out);
+        REQUIRE(out.empty());
+    }
+
+    SUBCASE("Single cell change")
+    {
+        scr.put(3, 1, U'O', fg::green);
+        out.clear();
+        scr.render(out);
+        REQUIRE(out == "\033[2;4H\033[32mO\033[0m");
+    }
+
+    SUBCASE("Invalidate repaints everything")
+    {
+        scr.invalidate();
+        out.clear();
+        scr.render(out);
+        REQUIRE(out.find("\033[2J") != string::npos);
+        REQUIRE(out.find("\xc3\xa9t\xc3\xa9") != string::npos);
+    }
+}
+
+TEST_CASE("Transcoder maps extended colors to the basic 16")
+{
+    const auto transcode = [](const string &in, bool split) {
+        stringbuf sink;
+        {
+            transcodeBuf buf(&sink);
+            if (split) {
+                for (const char c : in) {
+                    buf.sputn(&c, 1);
+                    buf.pubsync();
+                }
+            } else {
+                buf.sputn(in.data(), static_cast<streamsize>(in.size()));
+            }
+        }
+        return sink.str();
+    };
+
+    const string in = "a\033[38;5;196mred\033[0m \033[1;48;2;0;0;230;38;5;2mx"
+                      "\033[2J\033[31mkeep\033]0;title\007";
+    const string expected = "a\033[91mred\033[0m \033[1;44;32mx"
+                            "\033[2J\033[31mkeep\033]0;title\007";
+    REQUIRE(transcode(in, false) == expected);
+    REQUIRE(transcode(in, true) == expected);
+    REQUIRE(transcode("plain text", false) == "plain text");
+    REQUIRE(transcode("\033[38;5;232m", false) == "\033[30m");
+    REQUIRE(transcode("\033[48;2;250;250;250m", false) == "\033[107m");
+}
+
+TEST_CASE("Recorder tees output and replays it")
+{
+    const string fileName = "session.rangrec";
+    stringbuf sink;
+    string all;
+    {
+        recordBuf rec(&sink, fileName);
+        REQUIRE(rec.good());
+        ostream out(&rec);
+        for (int i = 0; i < 5000; ++i) {
+            const string line = "line " + to_string(i) + " \xe2\x9c\x93\n";
+            out << line << flush;
+            all += line;
+        }
+    }
+    REQUIRE(sink.str() == all);
+
+    replay session(fileName);
+    REQUIRE(session.good());
+
+    string replayed;
+    vector<uint64_t> times;
+    replay::frame f;
+    while (session.next(f)) {
+        replayed.append(f.data, f.size);
+        times.push_back(f.time);
+    }
+    REQUIRE(replayed == all);
+    REQUIRE(times.size() == 5000);
+
+    SUBCASE("Seek lands on the first frame at or after a time")
+    {
+        const uint64_t target = times[3777];
+        session.seek(target);
+        REQUIRE(session.next(f));
+        const size_t first = static_cast<size_t>(
+          lower_bound(times.begin(), times.end(), target) - times.begin());
+        REQUIRE(f.time == times[first]);
+        REQUIRE(string(f.data, f.size) == "line " + to_string(first)
+                  + " \xe2\x9c\x93\n");
+    }
+
+    SUBCASE("Asciicast export")
+    {
+        session.rewind();
+        ostringstream cast;
+        exportAsciicast(session, cast, 80, 24);
+        const string text = cast.str();
+        REQUIRE(text.find("{\"version\": 2, \"width\": 80, \"height\": 24")
+                == 0);
+        REQUIRE(text.find("\"line 0 \xe2\x9c\x93\\u000a\"]") != string::npos);
+    }
+
+    remove(fileName.c_str());
+}
+
+TEST_CASE("Asciicast export replaces invalid UTF-8")
+{
+    const string fileName = "invalid.rangrec";
+    {
+        stringbuf sink;
+        recordBuf rec(&sink, fileName);
+        ostream out(&rec);
+        // Stray byte, a check mark split across frames, an encoded
+        // surrogate, and a sequence cut off by the end of the recording
+        out << "a\xff" << flush << "\xe2\x9c" << flush << "\x93"
+            << "b" << flush << "\xed\xa0\x80" << flush << "\xe2\x82";
+    }
+    replay session(fileName);
+    REQUIRE(session.good());
+    ostringstream cast;
+    exportAsciicast(session, cast, 80, 24);
+
+    vector<string> events;
+    istringstream lines(cast.str());
+    string line;
+    getline(lines, line);
+    while (getline(lines, line)) {
+        const size_t open = line.find(", \"o\", \"") + 8;
+        events.push_back(line.substr(open, line.size() - open - 2));
+    }
+    REQUIRE(events.size() == 6);
+    REQUIRE(events[0] == "a\\ufffd");
+    REQUIRE(events[1] == "");
+    REQUIRE(events[2] == "\xe2\x9c\x93" "b");
+    REQUIRE(events[3] == "\\ufffd\\ufffd\\ufffd");
+    REQUIRE(events[4] == "");
+    REQUIRE(events[5] == "\\ufffd");
+
+    remove(fileName.c_str());
+}
+
+TEST_CASE("Markup compiles tags into transitions")
+{
+    setControlMode(control::Force);
+    const auto render = [](const markup &program, int value) {
+        ostringstream out;
+        out << program(value);
+        return out.str();
+    };
+
+    const markup program("[red bold]error[/] in [cyan]{}[/] done");
+    REQUIRE(render(program, 42)
+            == "\033[1;31merror\033[0m in \033[36m42\033[0m done");
+    REQUIRE(render(program, 7)
+            == "\033[1;31merror\033[0m in \033[36m7\033[0m done");
+
+    ostringstream nested;
+    nested << RANG_MARKUP("[on-bright-blue]a[bright-yellow]b[/]c[/]")();
+    REQUIRE(nested.str() == "\033[104ma\033[93mb\033[39mc\033[0m");
+
+    ostringstream literal;
+    markup("[[x] [unknown]{{}} {}{}[/]").print(literal, "y");
+    REQUIRE(literal.str() == "[x] [unknown]{} y{}[/]");
+
+    static const char format[] = "[green]{}[/]";
+    static const char copy[]   = "[green]{}[/]";
+    const markup &cached       = markup::cached(format);
+    REQUIRE(&markup::cached(format) == &cached);
+    REQUIRE(&markup::cached(copy) != &cached);
+    REQUIRE(render(cached, 5) == "\033[32m5\033[0m");
+
+    setControlMode(control::Off);
+    REQUIRE(render(program, 1) == "error in 1 done");
+    setControlMode(control::Auto);
+}
+
+TEST_CASE("Heat scale colors numbers by threshold")
+{
+    const heatScale latency({ { 0, fg::green },
+                              { 100, fg::yellow },
+                              { 500, attribute(fg::red).apply(style::bold) } });
+    REQUIRE(latency.at(-1) == attribute());
+    REQUIRE(latency.at(0) == attribute(fg::green));
+    REQUIRE(latency.at(99.9) == attribute(fg::green));
+    REQUIRE(latency.at(100) == attribute(fg::yellow));
+    REQUIRE(latency.at(1e9).has(style::bold));
+
+    setControlMode(control::Force);
+    ostringstream out;
+    out << heat(42, latency) << ' ' << heat(250.25, latency, 1) << ' '
+        << setw(6) << heat(-3, latency) << ' ' << heat(512u, latency);
+    REQUIRE(out.str()
+            == "\033[32m42\033[0m \033[33m250.3\033[0m     -3 "
+               "\033[1;31m512\033[0m");
+
+    setControlMode(control::Off);
+    ostringstream plain;
+    plain << heat(0.5, latency, 3) << ' ' << left << setw(4)
+          << heat(-0.0001, latency, 2) << '|';
+    REQUIRE(plain.str() == "0.500 0.00|");
+
+    // Wide fields are padded in full on both sides
+    for (const control mode : { control::Force, control::Off }) {
+        setControlMode(mode);
+        ostringstream wide;
+        wide << setw(100) << heat(7, latency) << left << setfill('.')
+             << setw(70) << heat(-1, latency) << '|';
+        const string color = mode == control::Force ? "\033[32m" : "";
+        const string reset = mode == control::Force ? "\033[0m" : "";
+        REQUIRE(wide.str()
+                == string(99, ' ') + color + "7" + reset + "-1"
+                  + string(68, '.') + "|");
+    }
+
+    // Failed streams are left alone and short writes set badbit
+    setControlMode(control::Force);
+    ostringstream failed;
+    failed.setstate(ios_base::failbit);
+    failed << heat(42, latency);
+    REQUIRE(failed.str().empty());
+    REQUIRE_FALSE(failed.bad());
+
+    struct fullBuf : streambuf {
+    } full;
+    ostream shortWrite(&full);
+    shortWrite << heat(42, latency);
+    REQUIRE(shortWrite.bad());
+    setControlMode(control::Auto);
+}
+
+template <typename CharT>
+static basic_string<CharT> styledWith()
+{
+    basic_stringbuf<CharT> buf;
+    basic_ostream<CharT> os(&buf);
+    os << fg::red << style::bold << bgB::gray << style::reset;
+    return buf.str();
+}
+
+template <typename CharT>
+static bool sameText(const basic_string<CharT> &text, const char *expected)
+{
+    const basic_string<CharT> widened(expected,
+                                      expected + std::strlen(expected));
+    return text == widened;
+}
+
+TEST_CASE("Rang printing with other character types")
+{
+    const char *expected = "\033[31m\033[1m\033[107m\033[0m";
+
+    setControlMode(control::Force);
+    REQUIRE(styledWith<char>() == expected);
+    REQUIRE(sameText(styledWith<wchar_t>(), expected));
+    REQUIRE(sameText(styledWith<char16_t>(), expected));
+    REQUIRE(sameText(styledWith<char32_t>(), expected));
+#ifdef __cpp_char8_t
+    REQUIRE(sameText(styledWith<char8_t>(), expected));
+#endif
+
+    wostringstream wide;
+    wide << fg::green << L"wide" << fg::reset;
+    REQUIRE(wide.str() == L"\033[32mwide\033[39m");
+
+    setControlMode(control::Off);
+    REQUIRE(styledWith<wchar_t>().empty());
+    REQUIRE(styledWith<char32_t>().empty());
+
+    // Standard wide streams are detected like the narrow ones
+    setControlMode(control::Auto);
+    REQUIRE(rang_implementation::standardStream(wcout.rdbuf()) == 1);
+    REQUIRE(rang_implementation::standardStream(wcerr.rdbuf()) == 2);
+    REQUIRE(rang_implementation::standardStream(wclog.rdbuf()) == 2);
+    REQUIRE(rang_implementation::isTerminal(wcout.rdbuf())
+            == rang_implementation::isTerminal(cout.rdbuf()));
+}
+
+TEST_CASE("Layout renders log lines from a compiled pattern")
+{
+    const attribute error = attribute(fg::red).apply(style::bold);
+    const layout lines("%t{dim} %L{level} [%n{cyan}] %m %% %q",
+                       { { 0, "INFO", fg::green }, { 2, "ERROR", error } });
+
+    logEvent event(2, "db", "connection lost");
+    event.time   = chrono::system_clock::time_point(
+      chrono::milliseconds(1760875200123LL));
+    event.thread = 7;
+
+    string plain;
+    lines.format(plain, event, false);
+    REQUIRE(plain
+            == "2025-10-19 12:00:00.123 ERROR [db] connection lost % %q\n");
+
+    string colored;
+    lines.format(colored, event, true);
+    REQUIRE(colored
+            == "\033[2m2025-10-19 12:00:00.123\033[0m \033[1;31mERROR\033[0m "
+               "[\033[36mdb\033[0m] connection lost % %q\n");
+
+    const layout other("%L{level}/%T %m{bogus}", { { 0, "INFO", fg::green } });
+    event.level = 5;
+    string unknown;
+    other.format(unknown, event, true);
+    REQUIRE(unknown == "5/7 connection lost{bogus}\n");
+
+    setControlMode(control::Force);
+    ostringstream out;
+    lines.write(out, logEvent(0, string("app"), string("up")));
+    REQUIRE(out.str().find("\033[32mINFO\033[0m [\033[36mapp\033[0m] up %")
+            == 32);
+    setControlMode(control::Auto);
+}
+
+TEST_CASE("Diff renders unified hunks with changed words")
+{
+    const string from = "one\ntwo\nthree\nfour\nfive\nsix\nseven\n"
+                        "eight\nnine\nten\n";
+    const string to = "one\ntwo\nthree\nfour\nfive\nsix\nseven\n"
+                      "eight\nnine\nTEN\neleven";
+
+    setControlMode(control::Off);
+    ostringstream plain;
+    REQUIRE(diff(plain, from, to));
+    REQUIRE(plain.str()
+            == "--- a\n+++ b\n@@ -7,4 +7,5 @@\n seven\n eight\n nine\n"
+               "-ten\n+TEN\n+eleven\n\\ No newline at end of file\n");
+
+    ostringstream same;
+    REQUIRE_FALSE(diff(same, from, from));
+    REQUIRE(same.str().empty());
+
+    setControlMode(control::Force);
+    diffOptions options;
+    options.context = 0;
+    ostringstream colored;
+    diff(colored, "x = 1;\nkeep\n", "x = 2;\nkeep\n", options);
+    REQUIRE(colored.str()
+            == "\033[1m--- a\033[0m\n\033[1m+++ b\033[0m\n"
+               "\033[36m@@ -1,1 +1,1 @@\033[0m\n"
+               "\033[31m-x = \033[7m1\033[0;31m;\033[0m\n"
+               "\033[32m+x = \033[7m2\033[0;32m;\033[0m\n");
+    setControlMode(control::Auto);
+
+    // Results must agree with a brute force edit distance
+    unsigned seed = 7;
+    const auto next = [&] {
+        seed = seed * 1103515245u + 12345u;
+        return (seed >> 16) % 4;
+    };
+    for (int round = 0; round < 200; ++round) {
+        string x, y;
+        for (int i = 0; i < 12; ++i) {
+            x += static_cast<char>('a' + next());
+            x += '\n';
+            y += static_cast<char>('a' + next());
+            y += '\n';
+        }
+        vector<vector<int>> dist(13, vector<int>(13));
+        for (int i = 0; i <= 12; ++i) {
+            for (int j = 0; j <= 12; ++j) {
+                dist[i][j] = i == 0 ? j
+                  : j == 0          ? i
+                  : x[2 * i - 2] == y[2 * j - 2]
+                  ? dist[i - 1][j - 1]
+                  : 1 + min(dist[i - 1][j], dist[i][j - 1]);
+            }
+        }
+        diffOptions full;
+        full.words = false;
+        ostringstream out;
+        setControlMode(control::Off);
+        diff(out, x, y, full);
+        const string text = out.str();
+        int edits = 0;
+        for (size_t p = 0; p < text.size(); p = text.find('\n', p) + 1) {
+            if ((text[p] == '-' || text[p] == '+') && text[p + 1] != text[p]) {
+                ++edits;
+            }
+        }
+        REQUIRE(edits == dist[12][12]);
+    }
+    setControlMode(control::Auto);
+}
+
+TEST_CASE("Terminal query replies are parsed as they arrive")
+{
+    using rang_implementation::parseReplies;
+    terminalInfo info;
+    const string osc = "\033]11;rgb:ffff/8080/0\033";
+    REQUIRE_FALSE(parseReplies(osc.data(), osc.data() + osc.size(), info));
+    REQUIRE_FALSE(info.background);
+
+    const string all = "\033]11;rgb:ffff/8080/0\a\033P0+r5463\033\\"
+                       "\033[?1;2c";
+    REQUIRE(parseReplies(all.data(), all.data() + all.size(), info));
+    REQUIRE(info.answered);
+    REQUIRE(info.background);
+    REQUIRE(info.red == 255);
+    REQUIRE(info.green == 128);
+    REQUIRE(info.blue == 0);
+    REQUIRE_FALSE(info.truecolor);
+    REQUIRE_FALSE(info.dark());
+}
+
+#if defined(OS_LINUX) || defined(OS_MAC)
+namespace {
+
+enum queryOutcome {
+    queryStarted    = 1,
+    queryAnswered   = 2,
+    queryTruecolor  = 4,
+    queryBackground = 8,  // the 1c/20/24 background sent by the test
+    queryRestored   = 16,
+    queryStopped    = 32,
+    queryLeftover   = 64,  // input still unread after finish()
+};
+
+/* Run a terminalQuery in a child whose controlling terminal is the pty
+ * slave, from a background process group if asked, and return its
+ * queryOutcome bits as the exit status.
+ */
+pid_t startPtyQuery(int master, bool background, chrono::milliseconds timeout)
+{
+    const string name = ptsname(master);
+    const pid_t child = fork();
+    if (child != 0) {
+        return child;
+    }
+    close(master);
+    setsid();
+    const int slave = open(name.c_str(), O_RDWR);
+    ioctl(slave, TIOCSCTTY, 0);
+    if (background) {
+        const pid_t job = fork();
+        if (job != 0) {
+            int status = 0;
+            waitpid(job, &status, WUNTRACED);
+            if (WIFSTOPPED(status)) {
+                kill(job, SIGKILL);
+                waitpid(job, &status, 0);
+                _exit(queryStopped);
+            }
+            _exit(WIFEXITED(status) ? WEXITSTATUS(status) : queryStopped);
+        }
+        setpgid(0, 0);
+    }
+    terminalQuery query(slave);
+    int outcome             = query.start() ? queryStarted : 0;
+    const terminalInfo info = query.finish(timeout);
+    termios mode;
+    outcome |= info.answered ? queryAnswered : 0;
+    outcome |= info.truecolor ? queryTruecolor : 0;
+    outcome |= info.background && info.red == 0x1c && info.green == 0x20
+        && info.blue == 0x24 && info.dark()
+      ? queryBackground
+      : 0;
+    outcome |= tcgetattr(slave, &mode) == 0 && (mode.c_lflag & ICANON) != 0
+      ? queryRestored
+      : 0;
+    int unread = 0;
+    outcome |= ioctl(slave, FIONREAD, &unread) == 0 && unread != 0
+      ? queryLeftover
+      : 0;
+    _exit(outcome);
+}
+
+int finishPtyQuery(pid_t child)
+{
+    int status = 0;
+    waitpid(child, &status, 0);
+    return WIFEXITED(status) ? WEXITSTATUS(status) : queryStopped;
+}
+
+}  // namespace
+
+TEST_CASE("Terminal query against a scripted pty")
+{
+    const int master = posix_openpt(O_RDWR | O_NOCTTY);
+    REQUIRE(master >= 0);
+    REQUIRE(grantpt(master) == 0);
+    REQUIRE(unlockpt(master) == 0);
+
+    SUBCASE("Answering terminal")
+    {
+        const pid_t child
+          = startPtyQuery(master, false, chrono::milliseconds(2000));
+        pollfd ready = { master, POLLIN, 0 };
+        REQUIRE(poll(&ready, 1, 2000) == 1);
+        char sent[256];
+        const ssize_t n = read(master, sent, sizeof sent);
+        REQUIRE(n > 0);
+        const string queries(sent, static_cast<size_t>(n));
+        REQUIRE(queries.find("\033]11;?") != string::npos);
+        REQUIRE(queries.find("\033P+q524742") != string::npos);
+        REQUIRE(queries.find("\033[c") != string::npos);
+
+        const string replies = "\033]11;rgb:1c1c/2020/2424\033\\"
+                               "\033P1+r524742=382f382f38\033\\"
+                               "\033[?62;22c";
+        REQUIRE(write(master, replies.data(), replies.size())
+                == static_cast<ssize_t>(replies.size()));
+        REQUIRE(finishPtyQuery(child)
+                == (queryStarted | queryAnswered | queryTruecolor
+                    | queryBackground | queryRestored));
+    }
+
+    SUBCASE("Silent terminal")
+    {
+        const auto begin = chrono::steady_clock::now();
+        const pid_t child
+          = startPtyQuery(master, false, chrono::milliseconds(20));
+        REQUIRE(finishPtyQuery(child) == (queryStarted | queryRestored));
+        REQUIRE(chrono::steady_clock::now() - begin
+                < chrono::milliseconds(1000));
+    }
+
+    SUBCASE("Input past the reply buffer is discarded")
+    {
+        const pid_t child
+          = startPtyQuery(master, false, chrono::milliseconds(2000));
+        pollfd ready = { master, POLLIN, 0 };
+        REQUIRE(poll(&ready, 1, 2000) == 1);
+        char sent[256];
+        REQUIRE(read(master, sent, sizeof sent) > 0);
+        const string noise(2000, '\n');
+        REQUIRE(write(master, noise.data(), noise.size())
+                == static_cast<ssize_t>(noise.size()));
+        REQUIRE(finishPtyQuery(child) == (queryStarted | queryRestored));
+    }
+
+    SUBCASE("Background process group")
+    {
+        // Must refuse instead of being stopped by SIGTTOU
+        const pid_t child
+          = startPtyQuery(master, true, chrono::milliseconds(20));
+        REQUIRE(finishPtyQuery(child) == queryRestored);
+    }
+
+    SUBCASE("Not a terminal")
+    {
+        terminalQuery query(-1);
+        REQUIRE_FALSE(query.start());
+        REQUIRE_FALSE(query.finish().answered);
+    }
+
+    close(master);
+}
+#endif
@@ -0,0 +1,521 @@
+// rang-cat: colorize log files by log level, timestamps and key=value fields.
+//
+//   rang-cat [-j threads] [--color=auto|always|never] [file...]
+//
+// Regular files are memory mapped and split at newline boundaries into
+// chunks which worker threads colorize in parallel; the results are written
+// in the original order. Anything that cannot be mapped (pipes, stdin) is
+// streamed through the same pipeline, a line at a time as soon as it is read.
+
+#include "rang.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#if defined(__unix__) || defined(__unix) || defined(__linux__)                \
+  || defined(__APPLE__) || defined(__MACH__)
+#define RANG_CAT_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+const std::size_t chunkSize = 1 << 20;
+
+struct rules {
+    std::string timestamp[2];
+    std::string fatal[2];
+    std::string error[2];
+    std::string warn[2];
+    std::string info[2];
+    std::string debug[2];
+    std::string trace[2];
+    std::string key[2];
+};
+
+template <typename T>
+void setRule(std::string (&rule)[2], T const value)
+{
+    rule[0] = rang::rang_implementation::openSequence(value);
+    rule[1] = rang::rang_implementation::closeSequence(value);
+}
+
+rules defaultRules()
+{
+    rules r;
+    setRule(r.timestamp, rang::fg::blue);
+    setRule(r.fatal, rang::bg::red);
+    setRule(r.error, rang::fg::red);
+    setRule(r.warn, rang::fg::yellow);
+    setRule(r.info, rang::fg::green);
+    setRule(r.debug, rang::fg::cyan);
+    setRule(r.trace, rang::fgB::black);
+    setRule(r.key, rang::fg::magenta);
+    return r;
+}
+
+bool isDigit(char c) { return c >= '0' && c <= '9'; }
+
+bool isWord(char c)
+{
+    return isDigit(c) || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+      || c == '_' || c == '.' || c == '-';
+}
+
+void append(std::string &out, const std::string (&rule)[2], const char *text,
+            std::size_t size)
+{
+    out += rule[0];
+    out.append(text, size);
+    out += rule[1];
+}
+
+// Length of a leading timestamp such as "2024-01-31 12:00:00.123Z", or 0
+std::size_t timestampLength(const char *line, std::size_t size)
+{
+    std::size_t i = 0;
+    bool separator = false;
+    while (i < size) {
+        const char c = line[i];
+        if (isDigit(c)) {
+            ++i;
+        } else if (c == '-' || c == ':' || c == '.' || c == ',' || c == '/'
+                   || c == '+' || ((c == 'T' || c == ' ') && i != 0)) {
+            separator = true;
+            ++i;
+        } else if (c == 'Z' && i != 0) {
+            ++i;
+            break;
+        } else {
+            break;
+        }
+    }
+    // Do not swallow the space in front of whatever follows
+    while (i > 0 && (line[i - 1] == ' ' || line[i - 1] == 'T')) {
+        --i;
+    }
+    return i >= 8 && separator && isDigit(line[0]) ? i : 0;
+}
+
+const std::string (*levelRule(const rules &r, const char *word,
+                              std::size_t size))[2]
+{
+    struct level {
+        const char *name;
+        const std::string(rules::*rule)[2];
+    };
+    static const level levels[]
+      = { { "FATAL", &rules::fatal },    { "CRITICAL", &rules::fatal },
+          { "ERROR", &rules::error },    { "ERR", &rules::error },
+          { "WARN", &rules::warn },      { "WARNING", &rules::warn },
+          { "INFO", &rules::info },      { "DEBUG", &rules::debug },
+          { "TRACE", &rules::trace } };
+    for (const level &l : levels) {
+        if (std::strlen(l.name) == size
+            && std::memcmp(l.name, word, size) == 0) {
+            return &(r.*l.rule);
+        }
+    }
+    return nullptr;
+}
+
+void colorizeLine(const rules &r, const char *line, std::size_t size,
+                  std::string &out)
+{
+    std::size_t i = timestampLength(line, size);
+    if (i != 0) {
+        append(out, r.timestamp, line, i);
+    }
+    bool levelSeen = false;
+    while (i < size) {
+        std::size_t end = i;
+        if (!isWord(line[i])) {
+            while (end < size && !isWord(line[end])) {
+                ++end;
+            }
+            out.append(line + i, end - i);
+            i = end;
+            continue;
+        }
+        while (end < size && isWord(line[end])) {
+            ++end;
+        }
+        const std::string(*rule)[2] = nullptr;
+        if (!levelSeen && (rule = levelRule(r, line + i, end - i))) {
+            levelSeen = true;
+            append(out, *rule, line + i, end - i);
+        } else if (end < size && line[end] == '=') {
+            append(out, r.key, line + i, end - i);
+        } else {
+            out.append(line + i, end - i);
+        }
+        i = end;
+    }
+}
+
+void colorize(const rules &r, const char *data, std::size_t size,
+              std::string &out)
+{
+    out.reserve(size + size / 4);
+    const char *end = data + size;
+    while (data < end) {
+        const char *nl = static_cast<const char *>(
+          std::memchr(data, '\n', static_cast<std::size_t>(end - data)));
+        const char *lineEnd = nl ? nl : end;
+        colorizeLine(r, data, static_cast<std::size_t>(lineEnd - data), out);
+        if (nl) {
+            out += '\n';
+        }
+        data = lineEnd + 1;
+    }
+}
+
+struct chunk {
+    std::string owned;
+    const char *data = nullptr;
+    std::size_t size = 0;
+    std::string out;
+    bool ready = false;
+};
+
+class source {
+public:
+    virtual ~source() = default;
+    // Fill c with the next newline terminated piece of input
+    virtual bool next(chunk &c) = 0;
+};
+
+class memorySource : public source {
+public:
+    memorySource(const char *data, std::size_t size)
+        : pos(data), end(data + size)
+    {
+    }
+
+    bool next(chunk &c) override
+    {
+        if (pos == end) {
+            return false;
+        }
+        const char *cut = end;
+        if (static_cast<std::size_t>(end - pos) > chunkSize) {
+            const char *nl = static_cast<const char *>(std::memchr(
+              pos + chunkSize, '\n',
+              static_cast<std::size_t>(end - pos) - chunkSize));
+            cut = nl ? nl + 1 : end;
+        }
+        c.data = pos;
+        c.size = static_cast<std::size_t>(cut - pos);
+        pos    = cut;
+        return true;
+    }
+
+private:
+    const char *pos;
+    const char *end;
+};
+
+/* Read what is available, up to size bytes: 0 at the end of the input and
+ * -1 with errno set on failure. read(2) returns as soon as a pipe or
+ * terminal has any data, so interactive input is never held back waiting
+ * for a full block.
+ */
+long readSome(std::FILE *file, char *data, std::size_t size)
+{
+#ifdef RANG_CAT_MMAP
+    ssize_t got;
+    do {
+        got = read(fileno(file), data, size);
+    } while (got < 0 && errno == EINTR);
+    return static_cast<long>(got);
+#else
+    const std::size_t got = std::fread(data, 1, size, file);
+    if (got == 0 && std::ferror(file)) {
+        return -1;
+    }
+    return static_cast<long>(got);
+#endif
+}
+
+class streamSource : public source {
+public:
+    explicit streamSource(std::FILE *file) : file(file), block(chunkSize) {}
+
+    // Every complete line read so far, without waiting for more input
+    bool next(chunk &c) override
+    {
+        c.owned.swap(carry);
+        carry.clear();
+        while (!eof) {
+            const long got = readSome(file, block.data(), block.size());
+            if (got <= 0) {
+                if (got < 0) {
+                    error = errno != 0 ? errno : EIO;
+                }
+                eof = true;
+                break;
+            }
+            const std::size_t old = c.owned.size();
+            c.owned.append(block.data(), static_cast<std::size_t>(got));
+            std::size_t nl = c.owned.size();
+            while (nl > old && c.owned[nl - 1] != '\n') {
+                --nl;
+            }
+            if (nl > old) {
+                carry.assign(c.owned, nl, std::string::npos);
+                c.owned.resize(nl);
+                break;
+            }
+        }
+        c.data = c.owned.data();
+        c.size = c.owned.size();
+        return c.size != 0;
+    }
+
+    // errno of a failed read, 0 when the input ended normally
+    int readError() const noexcept { return error; }
+
+private:
+    std::FILE *file;
+    std::vector<char> block;
+    std::string carry;
+    bool eof  = false;
+    int error = 0;
+};
+
+bool writeAll(const char *data, std::size_t size)
+{
+    return std::fwrite(data, 1, size, stdout) == size;
+}
+
+/* Workers claim chunks in input order and colorize them concurrently while
+ * the calling thread writes finished chunks in order. At most `window`
+ * chunks are in flight, which bounds memory regardless of input size.
+ * Reading happens outside the pipeline lock, under a lock of its own that
+ * keeps claims in input order, so a source blocked on a slow pipe does not
+ * stop finished chunks from being written. With flush set each chunk
+ * reaches stdout as soon as it is written.
+ */
+bool pipeline(source &src, const rules &r, unsigned threads, bool flush)
+{
+    const std::size_t window = threads * 4;
+    std::vector<chunk> slots(window);
+    std::mutex mutex, reading;
+    std::condition_variable spaceFree, chunkDone;
+    std::size_t claimed = 0, written = 0, total = 0;
+    bool exhausted = false;
+
+    auto worker = [&] {
+        while (true) {
+            std::unique_lock<std::mutex> reader(reading);
+            std::unique_lock<std::mutex> lock(mutex);
+            spaceFree.wait(lock, [&] {
+                return exhausted || claimed < written + window;
+            });
+            if (exhausted) {
+                return;
+            }
+            chunk &c = slots[claimed % window];
+            lock.unlock();
+            const bool more = src.next(c);
+            lock.lock();
+            if (!more) {
+                exhausted = true;
+                total     = claimed;
+                spaceFree.notify_all();
+                chunkDone.notify_all();
+                return;
+            }
+            ++claimed;
+            lock.unlock();
+            reader.unlock();
+            c.out.clear();
+            colorize(r, c.data, c.size, c.out);
+            lock.lock();
+            c.ready = true;
+            chunkDone.notify_all();
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.emplace_back(worker);
+    }
+
+    bool ok = true;
+    for (std::size_t seq = 0;; ++seq) {
+        std::unique_lock<std::mutex> lock(mutex);
+        chunk &c = slots[seq % window];
+        chunkDone.wait(lock,
+                       [&] { return c.ready || (exhausted && seq >= total); });
+        if (!c.ready) {
+            break;
+        }
+        lock.unlock();
+        ok = writeAll(c.out.data(), c.out.size()) && ok;
+        if (flush) {
+            ok = std::fflush(stdout) == 0 && ok;
+        }
+        lock.lock();
+        c.ready = false;
+        written = seq + 1;
+        spaceFree.notify_all();
+    }
+    for (std::thread &t : workers) {
+        t.join();
+    }
+    return ok;
+}
+
+bool copyStream(std::FILE *file, int &error)
+{
+    std::vector<char> buffer(chunkSize);
+    long got;
+    while ((got = readSome(file, buffer.data(), buffer.size())) > 0) {
+        if (!writeAll(buffer.data(), static_cast<std::size_t>(got))
+            || std::fflush(stdout) != 0) {
+            return false;
+        }
+    }
+    if (got < 0) {
+        error = errno != 0 ? errno : EIO;
+    }
+    return true;
+}
+
+bool catFile(const char *path, const rules *r, unsigned threads)
+{
+    const bool isStdin = std::strcmp(path, "-") == 0;
+#ifdef RANG_CAT_MMAP
+    if (!isStdin) {
+        const int fd = open(path, O_RDONLY | O_CLOEXEC);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+            && st.st_size > 0) {
+            const std::size_t size = static_cast<std::size_t>(st.st_size);
+            void *map = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+            close(fd);
+            if (map != MAP_FAILED) {
+                madvise(map, size, MADV_SEQUENTIAL);
+                const char *data = static_cast<const char *>(map);
+                bool ok;
+                if (r) {
+                    memorySource src(data, size);
+                    ok = pipeline(src, *r, threads, false);
+                } else {
+                    ok = writeAll(data, size);
+                }
+                munmap(map, size);
+                return ok;
+            }
+        } else if (fd >= 0) {
+            close(fd);
+        }
+    }
+#endif
+    std::FILE *file = isStdin ? stdin : std::fopen(path, "rb");
+    if (file == nullptr) {
+        std::fprintf(stderr, "rang-cat: %s: %s\n", path, std::strerror(errno));
+        return false;
+    }
+    bool ok;
+    int error = 0;
+    if (r) {
+        streamSource src(file);
+        ok    = pipeline(src, *r, threads, true);
+        error = src.readError();
+    } else {
+        ok = copyStream(file, error);
+    }
+    if (!isStdin) {
+        std::fclose(file);
+    }
+    if (error != 0) {
+        std::fprintf(stderr, "rang-cat: %s: %s\n", path, std::strerror(error));
+        return false;
+    }
+    return ok;
+}
+
+/* Thread count given to -j, at most four per hardware thread, or 0 when
+ * text is not a positive decimal number.
+ */
+unsigned parseThreads(const char *text)
+{
+    if (!isDigit(*text)) {
+        return 0;
+    }
+    char *end = nullptr;
+    errno     = 0;
+    const unsigned long value = std::strtoul(text, &end, 10);
+    if (*end != '\0' || value == 0) {
+        return 0;
+    }
+    const unsigned hardware = std::thread::hardware_concurrency();
+    const unsigned limit    = 4 * (hardware != 0 ? hardware : 1);
+    return errno == ERANGE || value > limit ? limit
+                                            : static_cast<unsigned>(value);
+}
+
+int usage()
+{
+    std::fprintf(stderr, "usage: rang-cat [-j threads] "
+                         "[--color=auto|always|never] [file...]\n");
+    return 2;
+}
+
+}  // namespace
+
+int main(int argc, char **argv)
+{
+    unsigned threads = std::thread::hardware_concurrency();
+    std::vector<const char *> files;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        if (arg.compare(0, 2, "-j") == 0) {
+            const char *count = argv[i] + 2;
+            if (*count == '\0' && i + 1 < argc) {
+                count = argv[++i];
+            }
+            if ((threads = parseThreads(count)) == 0) {
+                return usage();
+            }
+        } else if (arg == "--color=always") {
+            rang::setControlMode(rang::control::Force);
+        } else if (arg == "--color=never") {
+            rang::setControlMode(rang::control::Off);
+        } else if (arg == "--color=auto") {
+            rang::setControlMode(rang::control::Auto);
+        } else if (arg.size() > 1 && arg[0] == '-') {
+            return usage();
+        } else {
+            files.push_back(argv[i]);
+        }
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+    if (files.empty()) {
+        files.push_back("-");
+    }
+
+    const rules r = defaultRules();
+    const bool color
+      = rang::rang_implementation::ansiEnabled(std::cout.rdbuf());
+
+    bool ok = true;
+    for (const char *path : files) {
+        ok = catFile(path, color ? &r : nullptr, threads) && ok;
+    }
+    return std::fflush(stdout) == 0 && ok ? 0 : 1;
+}